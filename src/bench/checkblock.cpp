@@ -28,6 +28,48 @@ static void DeserializeBlockTest(benchmark::State& state)
     }
 }
 
+// Transaction sizes and weights are queried repeatedly after deserialization
+// (policy checks, mempool entries, block assembly). They are cached on
+// CTransaction at construction; BlockWeightRecomputeTest measures what each
+// query cost before, by serializing the transaction with and without witness.
+// block413567 has a Bitcoin header, which CBlockHeader here cannot read, so
+// only its transactions are deserialized.
+static std::vector<CTransactionRef> ReadBlockTransactions()
+{
+    CDataStream stream(benchmark::data::block413567, SER_NETWORK, PROTOCOL_VERSION);
+    stream.ignore(80);
+    std::vector<CTransactionRef> txs;
+    stream >> txs;
+    assert(!txs.empty());
+    return txs;
+}
+
+static void BlockWeightCachedTest(benchmark::State& state)
+{
+    const std::vector<CTransactionRef> txs = ReadBlockTransactions();
+
+    while (state.KeepRunning()) {
+        int64_t weight = 0;
+        for (const auto& tx : txs) {
+            weight += GetTransactionWeight(*tx);
+        }
+        assert(weight > 0);
+    }
+}
+
+static void BlockWeightRecomputeTest(benchmark::State& state)
+{
+    const std::vector<CTransactionRef> txs = ReadBlockTransactions();
+
+    while (state.KeepRunning()) {
+        int64_t weight = 0;
+        for (const auto& tx : txs) {
+            weight += ::GetSerializeSize(*tx, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) * (WITNESS_SCALE_FACTOR - 1) + ::GetSerializeSize(*tx, PROTOCOL_VERSION);
+        }
+        assert(weight > 0);
+    }
+}
+
 static void DeserializeAndCheckBlockTest(benchmark::State& state)
 {
     CDataStream stream(benchmark::data::block413567, SER_NETWORK, PROTOCOL_VERSION);
@@ -49,4 +91,6 @@ static void DeserializeAndCheckBlockTest(benchmark::State& state)
 }
 
 BENCHMARK(DeserializeBlockTest, 130);
+BENCHMARK(BlockWeightCachedTest, 300000);
+BENCHMARK(BlockWeightRecomputeTest, 14000);
 BENCHMARK(DeserializeAndCheckBlockTest, 160);
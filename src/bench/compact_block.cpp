@@ -0,0 +1,56 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <blockencodings.h>
+#include <consensus/merkle.h>
+#include <txmempool.h>
+#include <validation.h>
+
+#include <vector>
+
+// Cost of PartiallyDownloadedBlock::InitData, i.e. matching a compact
+// block's short IDs against the mempool, as the mempool grows. The block
+// holds 2000 transactions that are all in the mempool.
+static void CompactBlockReconstruction(benchmark::State& state, size_t mempool_size)
+{
+    constexpr size_t BLOCK_TXS = 2000;
+
+    CTxMemPool pool;
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(CMutableTransaction())); // coinbase
+    {
+        LOCK2(cs_main, pool.cs);
+        LockPoints lp;
+        for (size_t i = 0; i < mempool_size; ++i) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].scriptSig = CScript() << CScriptNum(i);
+            tx.vout.resize(1);
+            tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+            tx.vout[0].nValue = 10 * COIN;
+            const CTransactionRef ref = MakeTransactionRef(tx);
+            pool.addUnchecked(CTxMemPoolEntry(ref, 1000, /* time */ 0, /* height */ 1, /* spendsCoinbase */ false, /* sigOpsCost */ 4, lp));
+            // Spread the block's transactions over the whole mempool
+            if (i % (mempool_size / BLOCK_TXS) == 0 && block.vtx.size() <= BLOCK_TXS) {
+                block.vtx.push_back(ref);
+            }
+        }
+    }
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+
+    const CBlockHeaderAndShortTxIDs cmpctblock(block, /* fUseWTXID */ true);
+    const std::vector<std::pair<uint256, CTransactionRef>> extra_txn;
+    while (state.KeepRunning()) {
+        PartiallyDownloadedBlock partial_block(&pool);
+        const ReadStatus status = partial_block.InitData(cmpctblock, extra_txn);
+        assert(status == READ_STATUS_OK);
+    }
+}
+
+static void CompactBlockReconstruction10k(benchmark::State& state) { CompactBlockReconstruction(state, 10000); }
+static void CompactBlockReconstruction100k(benchmark::State& state) { CompactBlockReconstruction(state, 100000); }
+
+BENCHMARK(CompactBlockReconstruction10k, 50);
+BENCHMARK(CompactBlockReconstruction100k, 5);
@@ -6,6 +6,7 @@
 #include <policy/policy.h>
 #include <txmempool.h>
 
+#include <vector>
 
 static void AddTx(const CTransactionRef& tx, const CAmount& nFee, CTxMemPool& pool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs)
 {
@@ -129,4 +130,47 @@ static void MempoolEviction(benchmark::State& state)
     }
 }
 
+// Sustained inflow into a full mempool: every new transaction pushes usage
+// over the limit, the way LimitMempoolSize() sees it under spam at
+// -maxmempool. Trimming to the low-water mark batches the evictions.
+static void MempoolEvictionSustained(benchmark::State& state)
+{
+    std::vector<CTransactionRef> txs;
+    for (int i = 0; i < 2000; ++i) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << CScriptNum(i);
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << CScriptNum(i) << OP_EQUAL;
+        tx.vout[0].nValue = 10 * COIN;
+        txs.push_back(MakeTransactionRef(tx));
+    }
+
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    for (size_t i = 0; i < txs.size() / 2; ++i) {
+        AddTx(txs[i], 1000 + i, pool);
+    }
+    const size_t limit = pool.DynamicMemoryUsage();
+    std::vector<COutPoint> no_spends_remaining;
+
+    while (state.KeepRunning()) {
+        for (size_t i = txs.size() / 2; i < txs.size(); ++i) {
+            AddTx(txs[i], 1000 + i, pool);
+            if (pool.DynamicMemoryUsage() > limit) {
+                pool.TrimToSize(limit / 100 * MEMPOOL_TRIM_LOW_WATER_PERCENT, &no_spends_remaining);
+            }
+        }
+        // Restore the starting pool for the next round
+        for (size_t i = txs.size() / 2; i < txs.size(); ++i) {
+            pool.removeRecursive(*txs[i], MemPoolRemovalReason::CONFLICT);
+        }
+        for (size_t i = 0; i < txs.size() / 2; ++i) {
+            if (!pool.exists(txs[i]->GetHash())) AddTx(txs[i], 1000 + i, pool);
+        }
+        no_spends_remaining.clear();
+    }
+}
+
 BENCHMARK(MempoolEviction, 41000);
+BENCHMARK(MempoolEvictionSustained, 5);
@@ -84,4 +84,68 @@ static void ComplexMemPool(benchmark::State& state)
     }
 }
 
+static CTransactionRef MakeSpend(const std::vector<COutPoint>& prevouts, size_t n_outputs, size_t tx_counter)
+{
+    CMutableTransaction tx;
+    for (const COutPoint& prevout : prevouts) {
+        tx.vin.emplace_back(prevout);
+        tx.vin.back().scriptSig = CScript() << CScriptNum(tx_counter);
+    }
+    tx.vout.resize(n_outputs);
+    for (auto& out : tx.vout) {
+        out.scriptPubKey = CScript() << CScriptNum(tx_counter) << OP_EQUAL;
+        out.nValue = 10 * COIN;
+    }
+    return MakeTransactionRef(tx);
+}
+
+// A single long chain: every ancestor walk on insertion and every descendant
+// walk on removal covers the whole package.
+static void MempoolLongChain(benchmark::State& state)
+{
+    std::vector<CTransactionRef> chain;
+    COutPoint prevout(uint256S("01"), 0);
+    for (size_t i = 0; i < 500; ++i) {
+        chain.push_back(MakeSpend({prevout}, 1, i));
+        prevout = COutPoint(chain.back()->GetHash(), 0);
+    }
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    while (state.KeepRunning()) {
+        for (auto& tx : chain) {
+            AddTx(tx, pool);
+        }
+        pool.removeRecursive(*chain.front(), MemPoolRemovalReason::CONFLICT);
+        assert(pool.size() == 0);
+    }
+}
+
+// A wide tree: a root with many children, each with a few children of
+// their own, so descendant walks fan out and ancestor walks revisit the root.
+static void MempoolWideTree(benchmark::State& state)
+{
+    std::vector<CTransactionRef> txs;
+    size_t tx_counter = 0;
+    txs.push_back(MakeSpend({COutPoint(uint256S("01"), 0)}, 100, tx_counter++));
+    const uint256 root_hash = txs.front()->GetHash();
+    for (uint32_t i = 0; i < 100; ++i) {
+        txs.push_back(MakeSpend({COutPoint(root_hash, i)}, 4, tx_counter++));
+        const uint256 child_hash = txs.back()->GetHash();
+        for (uint32_t j = 0; j < 4; ++j) {
+            txs.push_back(MakeSpend({COutPoint(child_hash, j)}, 1, tx_counter++));
+        }
+    }
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    while (state.KeepRunning()) {
+        for (auto& tx : txs) {
+            AddTx(tx, pool);
+        }
+        pool.removeRecursive(*txs.front(), MemPoolRemovalReason::CONFLICT);
+        assert(pool.size() == 0);
+    }
+}
+
 BENCHMARK(ComplexMemPool, 1);
+BENCHMARK(MempoolLongChain, 5);
+BENCHMARK(MempoolWideTree, 20);
@@ -0,0 +1,59 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <net.h>
+#include <protocol.h>
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <vector>
+
+// Serialize a stream of small relay messages, the kind of input the
+// p2p_transport_deserializer fuzz target consumes.
+static std::vector<uint8_t> MakeRelayTraffic()
+{
+    std::vector<uint8_t> buffer;
+    V1TransportSerializer serializer;
+    for (int i = 0; i < 1000; ++i) {
+        CSerializedNetMsg msg;
+        // Alternate inv announcements and transaction-sized payloads
+        msg.command = i % 2 ? NetMsgType::TX : NetMsgType::INV;
+        msg.data.assign(i % 2 ? 250 + i % 200 : 37, (uint8_t)i);
+        std::vector<unsigned char> header;
+        serializer.prepareForTransport(msg, header);
+        buffer.insert(buffer.end(), header.begin(), header.end());
+        buffer.insert(buffer.end(), msg.data.begin(), msg.data.end());
+    }
+    return buffer;
+}
+
+// Same driving loop as src/test/fuzz/p2p_transport_deserializer.cpp, with
+// the input fed in socket-sized chunks and every message dropped once
+// decoded, as after processing.
+static void P2PTransportDeserializer(benchmark::State& state)
+{
+    const std::vector<uint8_t> buffer = MakeRelayTraffic();
+    V1TransportDeserializer deserializer{Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION};
+    while (state.KeepRunning()) {
+        const char* pch = (const char*)buffer.data();
+        size_t n_bytes = buffer.size();
+        while (n_bytes > 0) {
+            const int handled = deserializer.Read(pch, std::min<size_t>(n_bytes, 0x10000));
+            if (handled < 0) {
+                break;
+            }
+            pch += handled;
+            n_bytes -= handled;
+            if (deserializer.Complete()) {
+                const CNetMessage msg = deserializer.GetMessage(Params().MessageStart(), std::numeric_limits<int64_t>::max());
+                assert(msg.m_valid_checksum);
+            }
+        }
+    }
+}
+
+BENCHMARK(P2PTransportDeserializer, 50);
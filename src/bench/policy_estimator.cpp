@@ -0,0 +1,52 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <policy/fees.h>
+#include <txmempool.h>
+
+#include <vector>
+
+// Cost of feeding one block's worth of transactions through the fee estimator:
+// tracking each transaction on mempool entry and then processing the block
+// that confirms them.
+static void BlockPolicyEstimatorBlock(benchmark::State& state)
+{
+    constexpr size_t TXS_PER_BLOCK = 1000;
+
+    std::vector<CTransactionRef> txs;
+    txs.reserve(TXS_PER_BLOCK);
+    for (size_t i = 0; i < TXS_PER_BLOCK; ++i) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << CScriptNum(i);
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx.vout[0].nValue = 10 * COIN;
+        txs.push_back(MakeTransactionRef(tx));
+    }
+
+    CBlockPolicyEstimator estimator;
+    unsigned int height = 1;
+    std::vector<const CTxMemPoolEntry*> no_entries;
+    estimator.processBlock(height, no_entries);
+
+    LockPoints lp;
+    while (state.KeepRunning()) {
+        std::vector<CTxMemPoolEntry> entries;
+        entries.reserve(TXS_PER_BLOCK);
+        std::vector<const CTxMemPoolEntry*> block;
+        block.reserve(TXS_PER_BLOCK);
+        for (size_t i = 0; i < TXS_PER_BLOCK; ++i) {
+            // Spread the feerates over a few hundred estimator buckets
+            const CAmount fee = 1000 + (i * 7919) % 100000;
+            entries.emplace_back(txs[i], fee, /* time */ 0, height, /* spendsCoinbase */ false, /* sigOpsCost */ 4, lp);
+            estimator.processTransaction(entries.back(), true);
+            block.push_back(&entries.back());
+        }
+        estimator.processBlock(++height, block);
+    }
+}
+
+BENCHMARK(BlockPolicyEstimatorBlock, 50);
@@ -0,0 +1,108 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <compat.h>
+#include <util/system.h>
+
+#include <vector>
+
+#ifdef USE_EPOLL
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Many mostly idle connections with a handful of them becoming readable per
+// round, which is what the network thread sees on a well-connected node.
+static constexpr size_t NUM_SOCKETS = 1000;
+static constexpr size_t ACTIVE_PER_ROUND = 8;
+
+namespace {
+struct SocketPairs {
+    std::vector<int> readers;
+    std::vector<int> writers;
+
+    SocketPairs()
+    {
+        RaiseFileDescriptorLimit(2 * NUM_SOCKETS + 64);
+        for (size_t i = 0; i < NUM_SOCKETS; ++i) {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) break;
+            readers.push_back(fds[0]);
+            writers.push_back(fds[1]);
+        }
+    }
+    ~SocketPairs()
+    {
+        for (int fd : readers) close(fd);
+        for (int fd : writers) close(fd);
+    }
+
+    void MakeActive(size_t round)
+    {
+        const char byte = 0;
+        for (size_t i = 0; i < ACTIVE_PER_ROUND; ++i) {
+            const size_t idx = (round * 131 + i * 97) % writers.size();
+            if (send(writers[idx], &byte, 1, 0) != 1) return;
+        }
+    }
+
+    void Drain(int fd)
+    {
+        char buf[16];
+        while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0) {}
+    }
+};
+} // namespace
+
+// Readiness polling as CConnman does it without epoll: rebuild the pollfd
+// array from every socket on each pass.
+static void SocketEventsPoll(benchmark::State& state)
+{
+    SocketPairs pairs;
+    size_t round = 0;
+    while (state.KeepRunning()) {
+        pairs.MakeActive(round++);
+        std::vector<struct pollfd> vpollfds;
+        vpollfds.reserve(pairs.readers.size());
+        for (int fd : pairs.readers) {
+            struct pollfd pfd = {};
+            pfd.fd = fd;
+            pfd.events = POLLIN;
+            vpollfds.push_back(pfd);
+        }
+        if (poll(vpollfds.data(), vpollfds.size(), 0) <= 0) continue;
+        for (const struct pollfd& pfd : vpollfds) {
+            if (pfd.revents & POLLIN) pairs.Drain(pfd.fd);
+        }
+    }
+}
+
+// Persistent edge-triggered registrations: only ready sockets are returned.
+static void SocketEventsEpoll(benchmark::State& state)
+{
+    SocketPairs pairs;
+    const int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    for (int fd : pairs.readers) {
+        struct epoll_event event = {};
+        event.events = EPOLLIN | EPOLLET;
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+    struct epoll_event events[64];
+    size_t round = 0;
+    while (state.KeepRunning()) {
+        pairs.MakeActive(round++);
+        const int nEvents = epoll_wait(epoll_fd, events, 64, 0);
+        for (int i = 0; i < nEvents; ++i) {
+            pairs.Drain(events[i].data.fd);
+        }
+    }
+    close(epoll_fd);
+}
+
+BENCHMARK(SocketEventsPoll, 2000);
+BENCHMARK(SocketEventsEpoll, 2000);
+#endif // USE_EPOLL
@@ -16,6 +16,9 @@
 
 #include <unordered_map>
 
+//! Short transaction IDs are the low 6 bytes of the SipHash
+static constexpr uint64_t SHORTTXID_MASK = 0xffffffffffffULL;
+
 CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID) :
         nonce(GetRand(std::numeric_limits<uint64_t>::max())),
         shorttxids(block.vtx.size() - 1), prefilledtxn(1), header(block) {
@@ -41,7 +44,7 @@ void CBlockHeaderAndShortTxIDs::FillShortTxIDSelector() const {
 
 uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const {
     static_assert(SHORTTXIDS_LENGTH == 6, "shorttxids calculation assumes 6-byte shorttxids");
-    return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffL;
+    return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & SHORTTXID_MASK;
 }
 
 
@@ -103,11 +106,26 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
         return READ_STATUS_FAILED; // Short ID collision
 
     std::vector<bool> have_txn(txn_available.size());
+    // Short IDs of mempool entries are computed four at a time, with the
+    // block's SipHash key set up once rather than per entry.
+    const PresaltedSipHasher shortid_hasher(cmpctblock.shorttxidk0, cmpctblock.shorttxidk1);
     {
     LOCK(pool->cs);
     const std::vector<std::pair<uint256, CTxMemPool::txiter> >& vTxHashes = pool->vTxHashes;
+    uint64_t batch_shortids[4];
     for (size_t i = 0; i < vTxHashes.size(); i++) {
-        uint64_t shortid = cmpctblock.GetShortID(vTxHashes[i].first);
+        const size_t lane = i % 4;
+        if (lane == 0) {
+            if (vTxHashes.size() - i >= 4) {
+                const uint256* const batch[4] = {&vTxHashes[i].first, &vTxHashes[i + 1].first, &vTxHashes[i + 2].first, &vTxHashes[i + 3].first};
+                shortid_hasher.Hash4(batch, batch_shortids);
+            } else {
+                for (size_t j = 0; j < vTxHashes.size() - i; j++) {
+                    batch_shortids[j] = shortid_hasher(vTxHashes[i + j].first);
+                }
+            }
+        }
+        uint64_t shortid = batch_shortids[lane] & SHORTTXID_MASK;
         std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
         if (idit != shorttxids.end()) {
             if (!have_txn[idit->second]) {
@@ -133,7 +151,7 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
     }
 
     for (size_t i = 0; i < extra_txn.size(); i++) {
-        uint64_t shortid = cmpctblock.GetShortID(extra_txn[i].first);
+        uint64_t shortid = shortid_hasher(extra_txn[i].first) & SHORTTXID_MASK;
         std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
         if (idit != shorttxids.end()) {
             if (!have_txn[idit->second]) {
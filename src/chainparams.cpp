@@ -368,7 +368,7 @@ public:
 
         checkpointData = {
             {
-                {0, uint256S("0x2b8d445931aa4ea9b52db1488d3641fa2d4f7a3c1f8151bfa99d017493129e97")},
+                {0, uint256S("0x00000aba6dbb5d4250ca76041f18c4939241e3f3d3bfff1e81e2866df3a2f995")},
             }
         };
 
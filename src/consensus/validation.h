@@ -130,12 +130,13 @@ class TxValidationState : public ValidationState<TxValidationResult> {};
 class BlockValidationState : public ValidationState<BlockValidationResult> {};
 
 // These implement the weight = (stripped_size * 4) + witness_size formula,
-// using only serialization with and without witness data. As witness_size
+// using only serialization with and without witness data (cached on
+// CTransaction at construction for single transactions). As witness_size
 // is equal to total_size - stripped_size, this formula is identical to:
 // weight = (stripped_size * 3) + total_size.
 static inline int64_t GetTransactionWeight(const CTransaction& tx)
 {
-    return ::GetSerializeSize(tx, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) * (WITNESS_SCALE_FACTOR - 1) + ::GetSerializeSize(tx, PROTOCOL_VERSION);
+    return int64_t{tx.GetStrippedSize()} * (WITNESS_SCALE_FACTOR - 1) + tx.GetTotalSize();
 }
 static inline int64_t GetBlockWeight(const CBlock& block)
 {
@@ -131,6 +131,111 @@ uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val)
     return v0 ^ v1 ^ v2 ^ v3;
 }
 
+PresaltedSipHasher::PresaltedSipHasher(uint64_t k0, uint64_t k1)
+{
+    v[0] = 0x736f6d6570736575ULL ^ k0;
+    v[1] = 0x646f72616e646f6dULL ^ k1;
+    v[2] = 0x6c7967656e657261ULL ^ k0;
+    v[3] = 0x7465646279746573ULL ^ k1;
+}
+
+uint64_t PresaltedSipHasher::operator()(const uint256& val) const
+{
+    uint64_t d = val.GetUint64(0);
+
+    uint64_t v0 = v[0], v1 = v[1], v2 = v[2], v3 = v[3] ^ d;
+
+    SIPROUND;
+    SIPROUND;
+    v0 ^= d;
+    d = val.GetUint64(1);
+    v3 ^= d;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= d;
+    d = val.GetUint64(2);
+    v3 ^= d;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= d;
+    d = val.GetUint64(3);
+    v3 ^= d;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= d;
+    v3 ^= ((uint64_t)4) << 59;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= ((uint64_t)4) << 59;
+    v2 ^= 0xFF;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+namespace {
+/** Four SipHash states, one per lane. Kept in one struct so the compiler
+ *  knows the lanes do not alias. */
+struct SipState4 {
+    uint64_t v0[4], v1[4], v2[4], v3[4];
+
+    void Round()
+    {
+        for (int l = 0; l < 4; ++l) {
+            v0[l] += v1[l]; v1[l] = ROTL(v1[l], 13); v1[l] ^= v0[l];
+            v0[l] = ROTL(v0[l], 32);
+            v2[l] += v3[l]; v3[l] = ROTL(v3[l], 16); v3[l] ^= v2[l];
+            v0[l] += v3[l]; v3[l] = ROTL(v3[l], 21); v3[l] ^= v0[l];
+            v2[l] += v1[l]; v1[l] = ROTL(v1[l], 17); v1[l] ^= v2[l];
+            v2[l] = ROTL(v2[l], 32);
+        }
+    }
+};
+} // namespace
+
+void PresaltedSipHasher::Hash4(const uint256* const vals[4], uint64_t out[4]) const
+{
+    SipState4 s;
+    uint64_t d[4];
+    for (int l = 0; l < 4; ++l) {
+        d[l] = vals[l]->GetUint64(0);
+        s.v0[l] = v[0];
+        s.v1[l] = v[1];
+        s.v2[l] = v[2];
+        s.v3[l] = v[3] ^ d[l];
+    }
+    s.Round();
+    s.Round();
+    for (int w = 1; w < 4; ++w) {
+        for (int l = 0; l < 4; ++l) {
+            s.v0[l] ^= d[l];
+            d[l] = vals[l]->GetUint64(w);
+            s.v3[l] ^= d[l];
+        }
+        s.Round();
+        s.Round();
+    }
+    for (int l = 0; l < 4; ++l) {
+        s.v0[l] ^= d[l];
+        s.v3[l] ^= ((uint64_t)4) << 59;
+    }
+    s.Round();
+    s.Round();
+    for (int l = 0; l < 4; ++l) {
+        s.v0[l] ^= ((uint64_t)4) << 59;
+        s.v2[l] ^= 0xFF;
+    }
+    s.Round();
+    s.Round();
+    s.Round();
+    s.Round();
+    for (int l = 0; l < 4; ++l) {
+        out[l] = s.v0[l] ^ s.v1[l] ^ s.v2[l] ^ s.v3[l];
+    }
+}
+
 uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint32_t extra)
 {
     /* Specialized implementation for efficiency */
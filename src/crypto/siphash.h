@@ -44,4 +44,22 @@ public:
 uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
 uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint32_t extra);
 
+/** SipHash-2-4 of many uint256 values under one key.
+ *
+ *  The keyed initial state is computed once at construction instead of for
+ *  every value, and Hash4 runs four independent hashes with their rounds
+ *  interleaved lane by lane, which the CPU (or the compiler's vectorizer)
+ *  can execute in parallel. Results are identical to SipHashUint256.
+ */
+class PresaltedSipHasher
+{
+private:
+    uint64_t v[4];
+
+public:
+    PresaltedSipHasher(uint64_t k0, uint64_t k1);
+    uint64_t operator()(const uint256& val) const;
+    void Hash4(const uint256* const vals[4], uint64_t out[4]) const;
+};
+
 #endif // BITCOIN_CRYPTO_SIPHASH_H
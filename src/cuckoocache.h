@@ -477,6 +477,23 @@ public:
             }
         return false;
     }
+
+    /** for_each_live calls `f` on every element which has not been marked
+     * for garbage collection. Used to persist the cache across restarts;
+     * re-inserting the visited elements into a fresh cache reproduces the
+     * live set (though not the epoch state).
+     *
+     * Not threadsafe with any concurrent insert or erase.
+     *
+     * @param f a callable taking a const Element&
+     */
+    template <typename F>
+    void for_each_live(F f) const
+    {
+        for (uint32_t i = 0; i < size; ++i)
+            if (!collection_flags.bit_is_set(i))
+                f(table[i]);
+    }
 };
 } // namespace CuckooCache
 
@@ -32,6 +32,10 @@ constexpr unsigned int MAX_FLTR_FILE_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for fltr?????.dat files */
 constexpr unsigned int FLTR_FILE_CHUNK_SIZE = 0x100000; // 1 MiB
 
+/** Maximum number of checkpoint filter headers kept in memory per index. At one entry per
+ *  CFCHECKPT_INTERVAL blocks this covers two million blocks. */
+constexpr size_t CF_HEADERS_CACHE_MAX_SZ{2000};
+
 namespace {
 
 struct DBVal {
@@ -387,13 +391,32 @@ bool BlockFilterIndex::LookupFilter(const CBlockIndex* block_index, BlockFilter&
     return ReadFilterFromDisk(entry.pos, filter_out);
 }
 
-bool BlockFilterIndex::LookupFilterHeader(const CBlockIndex* block_index, uint256& header_out) const
+bool BlockFilterIndex::LookupFilterHeader(const CBlockIndex* block_index, uint256& header_out)
 {
+    LOCK(m_cs_headers_cache);
+
+    bool is_checkpoint{block_index->nHeight % CFCHECKPT_INTERVAL == 0};
+
+    if (is_checkpoint) {
+        // Try to find the block in the headers cache if this is a checkpoint height.
+        auto header = m_headers_cache.find(block_index->GetBlockHash());
+        if (header != m_headers_cache.end()) {
+            header_out = header->second;
+            return true;
+        }
+    }
+
     DBVal entry;
     if (!LookupOne(*m_db, block_index, entry)) {
         return false;
     }
 
+    if (is_checkpoint &&
+        m_headers_cache.size() < CF_HEADERS_CACHE_MAX_SZ) {
+        // Add to the headers cache if this is a checkpoint height.
+        m_headers_cache.emplace(block_index->GetBlockHash(), entry.header);
+    }
+
     header_out = entry.header;
     return true;
 }
@@ -406,13 +429,41 @@ bool BlockFilterIndex::LookupFilterRange(int start_height, const CBlockIndex* st
         return false;
     }
 
-    filters_out.resize(entries.size());
-    auto filter_staking_it = filters_out.begin();
-    for (const auto& entry : entries) {
-        if (!ReadFilterFromDisk(entry.pos, *filter_staking_it)) {
+    filters_out.clear();
+    filters_out.reserve(entries.size());
+
+    // Filters of consecutive blocks are normally written one after the other, so rather than
+    // opening the file and seeking for every filter, open each file once and only seek when the
+    // next filter is not where the previous one ended.
+    auto entry_it = entries.cbegin();
+    while (entry_it != entries.cend()) {
+        const int file_num = entry_it->pos.nFile;
+        CAutoFile filein(m_filter_fileseq->Open(entry_it->pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull()) {
             return false;
         }
-        ++filter_staking_it;
+        long file_pos = entry_it->pos.nPos;
+
+        for (; entry_it != entries.cend() && entry_it->pos.nFile == file_num; ++entry_it) {
+            if (entry_it->pos.nPos != file_pos) {
+                if (fseek(filein.Get(), entry_it->pos.nPos, SEEK_SET)) {
+                    return error("%s: Failed to seek to position %u in filter file %d",
+                                 __func__, entry_it->pos.nPos, file_num);
+                }
+            }
+
+            uint256 block_hash;
+            std::vector<unsigned char> encoded_filter;
+            try {
+                filein >> block_hash >> encoded_filter;
+                filters_out.emplace_back(GetFilterType(), block_hash, std::move(encoded_filter));
+            }
+            catch (const std::exception& e) {
+                return error("%s: Failed to deserialize block filter from disk: %s", __func__, e.what());
+            }
+            file_pos = entry_it->pos.nPos + GetSerializeSize(block_hash, CLIENT_VERSION) +
+                GetSerializeSize(filters_out.back().GetEncodedFilter(), CLIENT_VERSION);
+        }
     }
 
     return true;
@@ -26,12 +26,17 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef USE_POLL
 #include <poll.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/upnpcommands.h>
@@ -41,6 +46,7 @@
 static_assert(MINIUPNPC_API_VERSION >= 10, "miniUPnPc API version >= 10 assumed");
 #endif
 
+#include <algorithm>
 #include <unordered_map>
 
 #include <math.h>
@@ -75,6 +81,16 @@ enum BindFlags {
 // The sleep time needs to be small to avoid new sockets stalling
 static const uint64_t SELECT_TIMEOUT_MILLISECONDS = 50;
 
+#ifndef WIN32
+/** Maximum number of queued send buffers handed to the kernel in one sendmsg() (well below IOV_MAX) */
+static const size_t MAX_SEND_IOVECS = 64;
+#endif
+
+#ifdef USE_EPOLL
+/** Maximum number of socket events handled per epoll_wait() */
+static const int MAX_SOCKET_EVENTS = 1024;
+#endif
+
 const std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL; // SHA256("netgroup")[0:8]
@@ -534,6 +550,10 @@ void CNode::copyStats(CNodeStats &stats, const std::vector<bool> &m_asmap)
         X(mapRecvBytesPerMsgCmd);
         X(nRecvBytes);
     }
+    {
+        LOCK(cs_msgProcessingStats);
+        X(mapProcessingStatsPerMsgCmd);
+    }
     X(m_legacyWhitelisted);
     X(m_permissionFlags);
     if (m_tx_relay != nullptr) {
@@ -657,6 +677,9 @@ int V1TransportDeserializer::readHeader(const char *pch, unsigned int nBytes)
     // switch state to reading message data
     in_data = true;
 
+    // receive the payload into a recycled buffer if one is available
+    m_buffer_pool->Acquire(vRecv);
+
     return nCopy;
 }
 
@@ -685,9 +708,41 @@ const uint256& V1TransportDeserializer::GetMessageHash() const
     return data_hash;
 }
 
+void NetMessageBufferPool::Acquire(CDataStream& stream)
+{
+    LOCK(m_mutex);
+    if (m_buffers.empty()) return;
+    const int nType = stream.GetType();
+    const int nVersion = stream.GetVersion();
+    stream = std::move(m_buffers.back());
+    m_buffers.pop_back();
+    stream.SetType(nType);
+    stream.SetVersion(nVersion);
+}
+
+void NetMessageBufferPool::Release(CDataStream&& buffer, uint32_t payload_size)
+{
+    // A buffer's capacity never exceeds the largest payload it has held, as
+    // readData grows it to at most the message size, so this bounds the
+    // memory sitting idle in the pool.
+    if (payload_size > MAX_POOLED_RECV_BUFFER_SIZE) return;
+    buffer.clear();
+    LOCK(m_mutex);
+    if (m_buffers.size() < MAX_POOLED_RECV_BUFFERS) {
+        m_buffers.push_back(std::move(buffer));
+    }
+}
+
+CNetMessage::~CNetMessage()
+{
+    if (m_buffer_pool) {
+        m_buffer_pool->Release(std::move(m_recv), m_message_size);
+    }
+}
+
 CNetMessage V1TransportDeserializer::GetMessage(const CMessageHeader::MessageStartChars& message_start, int64_t time) {
     // decompose a single CNetMessage from the TransportDeserializer
-    CNetMessage msg(std::move(vRecv));
+    CNetMessage msg(std::move(vRecv), m_buffer_pool);
 
     // store state about valid header, netmagic and checksum
     msg.m_valid_header = hdr.IsValid(message_start);
@@ -737,27 +792,55 @@ size_t CConnman::SocketSendData(CNode *pnode) const EXCLUSIVE_LOCKS_REQUIRED(pno
     size_t nSentSize = 0;
 
     while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
-        assert(data.size() > pnode->nSendOffset);
+        assert(it->size() > pnode->nSendOffset);
+        size_t nRequested = 0;
         int nBytes = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#ifdef WIN32
+            nRequested = it->size() - pnode->nSendOffset;
+            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(it->data()) + pnode->nSendOffset, nRequested, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            // Gather the queued buffers (message headers and payloads are
+            // queued separately) into a single sendmsg() call.
+            struct iovec iov[MAX_SEND_IOVECS];
+            size_t nIov = 0;
+            size_t nOffset = pnode->nSendOffset;
+            for (auto iov_it = it; iov_it != pnode->vSendMsg.end() && nIov < MAX_SEND_IOVECS; ++iov_it, ++nIov) {
+                iov[nIov].iov_base = const_cast<unsigned char*>(iov_it->data()) + nOffset;
+                iov[nIov].iov_len = iov_it->size() - nOffset;
+                nRequested += iov[nIov].iov_len;
+                nOffset = 0;
+            }
+            struct msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = nIov;
+            nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            // Retire every buffer that went out completely and remember how
+            // far into the next one we got.
+            size_t nRemaining = nBytes;
+            while (nRemaining > 0) {
+                const size_t nLeft = it->size() - pnode->nSendOffset;
+                if (nRemaining < nLeft) {
+                    pnode->nSendOffset += nRemaining;
+                    break;
+                }
+                nRemaining -= nLeft;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
-                pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+                pnode->nSendSize -= it->size();
                 it++;
-            } else {
-                // could not send full message; stop sending more
+            }
+            pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+            if ((size_t)nBytes < nRequested) {
+                // could not send everything we offered; stop sending more
                 break;
             }
         } else {
@@ -780,9 +863,45 @@ size_t CConnman::SocketSendData(CNode *pnode) const EXCLUSIVE_LOCKS_REQUIRED(pno
         assert(pnode->nSendSize == 0);
     }
     pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
+#ifdef USE_EPOLL
+    UpdateSendEvents(pnode);
+#endif
     return nSentSize;
 }
 
+#ifdef USE_EPOLL
+bool CConnman::RegisterSocketEvents(SOCKET hSocket, bool edge_triggered)
+{
+    if (m_epoll_fd < 0) return false;
+    struct epoll_event event = {};
+    event.events = EPOLLIN | (edge_triggered ? (uint32_t)EPOLLET : 0);
+    event.data.fd = hSocket;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, hSocket, &event) != 0) {
+        LogPrintf("Failed to register socket %d for events: %s\n", hSocket, NetworkErrorString(WSAGetLastError()));
+        return false;
+    }
+    return true;
+}
+
+void CConnman::UpdateSendEvents(CNode* pnode) const
+{
+    const bool want_send = !pnode->vSendMsg.empty();
+    if (m_epoll_fd < 0 || want_send == pnode->m_send_events_armed) return;
+
+    LOCK(pnode->cs_hSocket);
+    if (pnode->hSocket == INVALID_SOCKET) return;
+    struct epoll_event event = {};
+    event.events = EPOLLIN | EPOLLET | (want_send ? (uint32_t)EPOLLOUT : 0);
+    event.data.fd = pnode->hSocket;
+    // Modifying an edge-triggered registration re-reports any readiness that
+    // is already present, so a socket that became writable in the meantime
+    // is not missed.
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, pnode->hSocket, &event) == 0) {
+        pnode->m_send_events_armed = want_send;
+    }
+}
+#endif
+
 struct NodeEvictionCandidate
 {
     NodeId id;
@@ -1035,6 +1154,9 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
 
     LogPrint(BCLog::NET, "connection from %s accepted\n", addr.ToString());
 
+#ifdef USE_EPOLL
+    RegisterSocketEvents(hSocket, /* edge_triggered */ true);
+#endif
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
@@ -1199,7 +1321,43 @@ bool CConnman::GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &s
     return !recv_set.empty() || !send_set.empty() || !error_set.empty();
 }
 
-#ifdef USE_POLL
+#if defined(USE_EPOLL)
+void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
+{
+    // Registrations are persistent, so there is nothing to rebuild here. Only
+    // skip the wait when a readable socket is still waiting to be drained.
+    const int timeout = m_recv_ready_serviceable ? 0 : SELECT_TIMEOUT_MILLISECONDS;
+    struct epoll_event events[MAX_SOCKET_EVENTS];
+    const int nEvents = epoll_wait(m_epoll_fd, events, MAX_SOCKET_EVENTS, timeout);
+
+    if (interruptNet) return;
+
+    if (nEvents < 0) {
+        const int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR) {
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(nErr));
+            interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        }
+        return;
+    }
+
+    for (int i = 0; i < nEvents; ++i) {
+        const SOCKET hSocket = events[i].data.fd;
+        const bool is_listen = std::any_of(vhListenSocket.begin(), vhListenSocket.end(),
+            [hSocket](const ListenSocket& listen) { return listen.socket == hSocket; });
+        if (events[i].events & EPOLLIN) {
+            if (is_listen) {
+                recv_set.insert(hSocket);
+            } else {
+                m_recv_ready_sockets.insert(hSocket);
+            }
+        }
+        if (events[i].events & EPOLLOUT)              send_set.insert(hSocket);
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) error_set.insert(hSocket);
+    }
+    recv_set.insert(m_recv_ready_sockets.begin(), m_recv_ready_sockets.end());
+}
+#elif defined(USE_POLL)
 void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
 {
     std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
@@ -1345,6 +1503,11 @@ void CConnman::SocketHandler()
         for (CNode* pnode : vNodesCopy)
             pnode->AddRef();
     }
+#ifdef USE_EPOLL
+    // Rebuilt below from the sockets that are still readable after this pass
+    std::set<SOCKET> still_ready;
+    bool still_ready_serviceable = false;
+#endif
     for (CNode* pnode : vNodesCopy)
     {
         if (interruptNet)
@@ -1356,14 +1519,31 @@ void CConnman::SocketHandler()
         bool recvSet = false;
         bool sendSet = false;
         bool errorSet = false;
+        SOCKET hSocket;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            recvSet = recv_set.count(pnode->hSocket) > 0;
-            sendSet = send_set.count(pnode->hSocket) > 0;
-            errorSet = error_set.count(pnode->hSocket) > 0;
+            hSocket = pnode->hSocket;
+            recvSet = recv_set.count(hSocket) > 0;
+            sendSet = send_set.count(hSocket) > 0;
+            errorSet = error_set.count(hSocket) > 0;
+        }
+#ifdef USE_EPOLL
+        if (recvSet) {
+            // Same policy GenerateSelectSet applies for select/poll: drain
+            // pending sends before receiving more, and respect fPauseRecv.
+            bool pending_send;
+            {
+                LOCK(pnode->cs_vSend);
+                pending_send = !pnode->vSendMsg.empty();
+            }
+            if (pnode->fPauseRecv || pending_send) {
+                still_ready.insert(hSocket);
+                recvSet = false;
+            }
         }
+#endif
         if (recvSet || errorSet)
         {
             // typical socket buffer is 8K-64K
@@ -1375,6 +1555,14 @@ void CConnman::SocketHandler()
                     continue;
                 nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
             }
+#ifdef USE_EPOLL
+            // A full buffer means the socket may hold more; anything short of
+            // that drained it and the next arrival raises a new edge.
+            if (nBytes == (int)sizeof(pchBuf)) {
+                still_ready.insert(hSocket);
+                still_ready_serviceable = true;
+            }
+#endif
             if (nBytes > 0)
             {
                 bool notify = false;
@@ -1434,6 +1622,10 @@ void CConnman::SocketHandler()
 
         InactivityCheck(pnode);
     }
+#ifdef USE_EPOLL
+    m_recv_ready_sockets.swap(still_ready);
+    m_recv_ready_serviceable = still_ready_serviceable;
+#endif
     {
         LOCK(cs_vNodes);
         for (CNode* pnode : vNodesCopy)
@@ -1455,9 +1647,9 @@ void CConnman::WakeMessageHandler()
 {
     {
         std::lock_guard<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = true;
+        ++nMsgProcWakeSeq;
     }
-    condMsgProc.notify_one();
+    condMsgProc.notify_all();
 }
 
 
@@ -2007,6 +2199,15 @@ void CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     if (manual_connection)
         pnode->m_manual_connection = true;
 
+#ifdef USE_EPOLL
+    // Register before InitializeNode queues our VERSION: if that first send
+    // is only partly written, UpdateSendEvents has to find the socket in the
+    // epoll set to arm EPOLLOUT, or the rest of the message is never sent.
+    {
+        LOCK(pnode->cs_hSocket);
+        RegisterSocketEvents(pnode->hSocket, /* edge_triggered */ true);
+    }
+#endif
     m_msgproc->InitializeNode(pnode);
     {
         LOCK(cs_vNodes);
@@ -2014,16 +2215,24 @@ void CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     }
 }
 
-void CConnman::ThreadMessageHandler()
+void CConnman::ThreadMessageHandler(int worker)
 {
+    uint64_t nWakeSeqSeen;
+    {
+        LOCK(mutexMsgProc);
+        nWakeSeqSeen = nMsgProcWakeSeq;
+    }
     while (!flagInterruptMsgProc)
     {
+        // Each peer is only ever handled by one worker, so per-peer state
+        // touched by ProcessMessages/SendMessages keeps a single writer.
         std::vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode* pnode : vNodesCopy) {
+            for (CNode* pnode : vNodes) {
+                if (pnode->GetId() % m_msgproc_threads != worker) continue;
                 pnode->AddRef();
+                vNodesCopy.push_back(pnode);
             }
         }
 
@@ -2057,9 +2266,9 @@ void CConnman::ThreadMessageHandler()
 
         WAIT_LOCK(mutexMsgProc, lock);
         if (!fMoreWork) {
-            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this] { return fMsgProcWake; });
+            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this, nWakeSeqSeen] { return nMsgProcWakeSeq != nWakeSeqSeen; });
         }
-        fMsgProcWake = false;
+        nWakeSeqSeen = nMsgProcWakeSeq;
     }
 }
 
@@ -2271,6 +2480,17 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         return false;
     }
 
+#ifdef USE_EPOLL
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll_fd < 0) {
+        LogPrintf("Failed to create epoll instance: %s\n", NetworkErrorString(WSAGetLastError()));
+        return false;
+    }
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        RegisterSocketEvents(hListenSocket.socket, /* edge_triggered */ false);
+    }
+#endif
+
     for (const auto& strDest : connOptions.vSeedNodes) {
         AddOneShot(strDest);
     }
@@ -2312,11 +2532,6 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
     interruptNet.reset();
     flagInterruptMsgProc = false;
 
-    {
-        LOCK(mutexMsgProc);
-        fMsgProcWake = false;
-    }
-
     // Send and receive from sockets, accept connections
     threadSocketHandler = std::thread(&TraceThread<std::function<void()> >, "net", std::function<void()>(std::bind(&CConnman::ThreadSocketHandler, this)));
 
@@ -2340,7 +2555,14 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this, connOptions.m_specified_outgoing)));
 
     // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    LogPrintf("Using %d message handler threads\n", m_msgproc_threads);
+    for (int i = 0; i < m_msgproc_threads; ++i) {
+        threadMessageHandlers.emplace_back([this, i] {
+            // Keep the historical name for the first worker
+            const std::string name = i == 0 ? "msghand" : strprintf("msghand.%d", i);
+            TraceThread(name.c_str(), [this, i] { ThreadMessageHandler(i); });
+        });
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery([this] { DumpAddresses(); }, DUMP_PEERS_INTERVAL);
@@ -2389,8 +2611,11 @@ void CConnman::Interrupt()
 
 void CConnman::StopThreads()
 {
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    for (std::thread& thread : threadMessageHandlers) {
+        if (thread.joinable())
+            thread.join();
+    }
+    threadMessageHandlers.clear();
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
@@ -2429,6 +2654,14 @@ void CConnman::StopNodes()
     vhListenSocket.clear();
     semOutbound.reset();
     semAddnode.reset();
+#ifdef USE_EPOLL
+    if (m_epoll_fd >= 0) {
+        close(m_epoll_fd);
+        m_epoll_fd = -1;
+    }
+    m_recv_ready_sockets.clear();
+    m_recv_ready_serviceable = false;
+#endif
 }
 
 void CConnman::DeleteNode(CNode* pnode)
@@ -2671,6 +2904,49 @@ uint64_t CConnman::GetTotalBytesSent()
     return nTotalBytesSent;
 }
 
+void MsgTimeHistogram::Add(int64_t usec)
+{
+    if (usec < 0) usec = 0;
+    size_t bucket = 0;
+    for (uint64_t v = usec; v != 0 && bucket + 1 < BUCKETS; v >>= 1) {
+        ++bucket;
+    }
+    ++buckets[bucket];
+    ++count;
+    total_usec += usec;
+}
+
+static void AddMessageProcessingSample(MsgProcessingStats& stats, int64_t queue_wait_usec, int64_t process_usec, int64_t cs_main_usec)
+{
+    stats.queue_wait.Add(queue_wait_usec);
+    stats.process.Add(process_usec);
+    stats.cs_main.Add(cs_main_usec);
+}
+
+void CConnman::RecordMessageProcessing(CNode* pnode, const std::string& msg_type, int64_t queue_wait_usec, int64_t process_usec, int64_t cs_main_usec)
+{
+    // Account unknown message types together, as mapRecvBytesPerMsgCmd does
+    const std::vector<std::string>& known_types = getAllNetMessageTypes();
+    const bool known = std::find(known_types.begin(), known_types.end(), msg_type) != known_types.end();
+    const std::string& key = known ? msg_type : NET_MESSAGE_COMMAND_OTHER;
+
+    pnode->RecordMessageProcessing(key, queue_wait_usec, process_usec, cs_main_usec);
+    LOCK(cs_msgProcessingStats);
+    AddMessageProcessingSample(mapProcessingStatsPerMsgCmd[key], queue_wait_usec, process_usec, cs_main_usec);
+}
+
+mapMsgCmdProcessingStats CConnman::GetMessageProcessingStats() const
+{
+    LOCK(cs_msgProcessingStats);
+    return mapProcessingStatsPerMsgCmd;
+}
+
+void CNode::RecordMessageProcessing(const std::string& msg_type, int64_t queue_wait_usec, int64_t process_usec, int64_t cs_main_usec)
+{
+    LOCK(cs_msgProcessingStats);
+    AddMessageProcessingSample(mapProcessingStatsPerMsgCmd[msg_type], queue_wait_usec, process_usec, cs_main_usec);
+}
+
 ServiceFlags CConnman::GetLocalServices() const
 {
     return nLocalServices;
@@ -2687,6 +2963,7 @@ int CConnman::GetBestHeight() const
 }
 
 unsigned int CConnman::GetReceiveFloodSize() const { return nReceiveFloodSize; }
+int CConnman::GetMsgProcThreads() const { return m_msgproc_threads; }
 
 CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn, SOCKET hSocketIn, const CAddress& addrIn, uint64_t nKeyedNetGroupIn, uint64_t nLocalHostNonceIn, const CAddress& addrBindIn, const std::string& addrNameIn, bool fInboundIn, bool block_relay_only)
     : nTimeConnected(GetSystemTimeInSeconds()),
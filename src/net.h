@@ -24,6 +24,7 @@
 #include <uint256.h>
 #include <threadinterrupt.h>
 
+#include <array>
 #include <atomic>
 #include <deque>
 #include <stdint.h>
@@ -77,6 +78,15 @@ static const bool DEFAULT_UPNP = false;
 #endif
 /** The maximum number of peer connections to maintain. */
 static const unsigned int DEFAULT_MAX_PEER_CONNECTIONS = 125;
+/** Largest message payload whose receive buffer is recycled for later messages */
+static const uint32_t MAX_POOLED_RECV_BUFFER_SIZE = 64 * 1024;
+/** Maximum number of idle receive buffers kept per connection */
+static const size_t MAX_POOLED_RECV_BUFFERS = 8;
+/** -msghandthreads default, number of threads processing peer messages. More than one is experimental:
+ *  most messages are still processed entirely under cs_main, so additional threads mostly wait for each other. */
+static const int DEFAULT_MSGPROC_THREADS = 1;
+/** Maximum number of message processing threads */
+static const int MAX_MSGPROC_THREADS = 16;
 /** The default for -maxuploadtarget. 0 = Unlimited */
 static const uint64_t DEFAULT_MAX_UPLOAD_TARGET = 0;
 /** The default timeframe for -maxuploadtarget. 1 day. */
@@ -116,6 +126,31 @@ struct CSerializedNetMsg
     std::string command;
 };
 
+/**
+ * Distribution of durations in power-of-two microsecond buckets: bucket 0
+ * counts durations below 1us, bucket i durations in [2^(i-1), 2^i) us, and
+ * the last bucket everything longer.
+ */
+struct MsgTimeHistogram
+{
+    static constexpr size_t BUCKETS = 24;
+
+    uint64_t count{0};
+    int64_t total_usec{0};
+    std::array<uint64_t, BUCKETS> buckets{};
+
+    void Add(int64_t usec);
+};
+
+/** Cost of processing the messages of one type */
+struct MsgProcessingStats
+{
+    MsgTimeHistogram queue_wait; //!< time from receipt until processing started
+    MsgTimeHistogram process;    //!< time spent in ProcessMessage
+    MsgTimeHistogram cs_main;    //!< time cs_main was held during ProcessMessage
+};
+typedef std::map<std::string, MsgProcessingStats> mapMsgCmdProcessingStats;
+
 
 class NetEventsInterface;
 class CConnman
@@ -146,6 +181,7 @@ public:
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
         int64_t m_peer_connect_timeout = DEFAULT_PEER_CONNECT_TIMEOUT;
+        int m_msgproc_threads = 1;
         std::vector<std::string> vSeedNodes;
         std::vector<NetWhitelistPermissions> vWhitelistedRange;
         std::vector<NetWhitebindPermissions> vWhiteBinds;
@@ -172,6 +208,7 @@ public:
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
         m_peer_connect_timeout = connOptions.m_peer_connect_timeout;
+        m_msgproc_threads = std::max(1, std::min(connOptions.m_msgproc_threads, MAX_MSGPROC_THREADS));
         {
             LOCK(cs_totalBytesSent);
             nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
@@ -312,6 +349,10 @@ public:
     uint64_t GetTotalBytesRecv();
     uint64_t GetTotalBytesSent();
 
+    /** Account the cost of processing one message from pnode, both for the peer and in the node-wide totals. */
+    void RecordMessageProcessing(CNode* pnode, const std::string& msg_type, int64_t queue_wait_usec, int64_t process_usec, int64_t cs_main_usec);
+    mapMsgCmdProcessingStats GetMessageProcessingStats() const;
+
     void SetBestHeight(int height);
     int GetBestHeight() const;
 
@@ -319,6 +360,7 @@ public:
     CSipHasher GetDeterministicRandomizer(uint64_t id) const;
 
     unsigned int GetReceiveFloodSize() const;
+    int GetMsgProcThreads() const;
 
     void WakeMessageHandler();
 
@@ -347,7 +389,8 @@ private:
     void AddOneShot(const std::string& strDest);
     void ProcessOneShot();
     void ThreadOpenConnections(std::vector<std::string> connect);
-    void ThreadMessageHandler();
+    /** Process messages for the peers pinned to this worker (NodeId modulo the number of workers) */
+    void ThreadMessageHandler(int worker);
     void AcceptConnection(const ListenSocket& hListenSocket);
     void DisconnectNodes();
     void NotifyNumConnectionsChanged();
@@ -355,6 +398,12 @@ private:
     bool GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
     void SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
     void SocketHandler();
+#ifdef USE_EPOLL
+    /** Add a socket to the epoll set; peer sockets are edge-triggered, listen sockets level-triggered */
+    bool RegisterSocketEvents(SOCKET hSocket, bool edge_triggered);
+    /** Ask for write readiness on pnode's socket only while it has queued data */
+    void UpdateSendEvents(CNode* pnode) const EXCLUSIVE_LOCKS_REQUIRED(pnode->cs_vSend);
+#endif
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
@@ -389,6 +438,10 @@ private:
     uint64_t nTotalBytesRecv GUARDED_BY(cs_totalBytesRecv) {0};
     uint64_t nTotalBytesSent GUARDED_BY(cs_totalBytesSent) {0};
 
+    // Message processing cost totals, including peers that are gone
+    mutable Mutex cs_msgProcessingStats;
+    mapMsgCmdProcessingStats mapProcessingStatsPerMsgCmd GUARDED_BY(cs_msgProcessingStats);
+
     // outbound limit & stats
     uint64_t nMaxOutboundTotalBytesSentInCycle GUARDED_BY(cs_totalBytesSent);
     uint64_t nMaxOutboundCycleStartTime GUARDED_BY(cs_totalBytesSent);
@@ -406,6 +459,15 @@ private:
     unsigned int nReceiveFloodSize{0};
 
     std::vector<ListenSocket> vhListenSocket;
+#ifdef USE_EPOLL
+    int m_epoll_fd{-1};
+    //! Peer sockets that reported readable and have not been drained yet.
+    //! Edge-triggered registrations won't report them again, so they are
+    //! serviced on every pass until recv() comes up short. Socket thread only.
+    std::set<SOCKET> m_recv_ready_sockets;
+    //! Whether some socket in m_recv_ready_sockets can be read right away (not paused)
+    bool m_recv_ready_serviceable{false};
+#endif
     std::atomic<bool> fNetworkActive{true};
     bool fAddressesInitialized{false};
     CAddrMan addrman;
@@ -456,8 +518,8 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake;
+    /** Bumped to wake the message processors; each worker remembers the last value it saw. */
+    uint64_t nMsgProcWakeSeq{0};
 
     std::condition_variable condMsgProc;
     Mutex mutexMsgProc;
@@ -469,7 +531,8 @@ private:
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageHandlers;
+    int m_msgproc_threads{1};
 
     /** flag for deciding to connect to an extra outbound peer,
      *  in excess of m_max_outbound_full_relay
@@ -504,6 +567,9 @@ struct CombinerAll
 
 /**
  * Interface for message handling
+ *
+ * ProcessMessages and SendMessages run concurrently on the message handler
+ * threads, but calls for any given node always come from the same thread.
  */
 class NetEventsInterface
 {
@@ -592,6 +658,7 @@ public:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    mapMsgCmdProcessingStats mapProcessingStatsPerMsgCmd;
     NetPermissionFlags m_permissionFlags;
     bool m_legacyWhitelisted;
     int64_t m_ping_usec;
@@ -609,6 +676,27 @@ public:
 
 
 
+/** Recycles the payload buffers of one connection's received messages.
+ *
+ * The deserializer takes a buffer from the pool for every message and the
+ * message hands it back when it is destroyed after processing, so steady
+ * relay traffic neither allocates nor frees (and, with CDataStream's
+ * zero_after_free_allocator, cleanses) a buffer per message. Buffers are
+ * acquired on the socket thread and released on a message handler thread.
+ */
+class NetMessageBufferPool
+{
+public:
+    /** Replace stream with an empty pooled buffer, if there is one, keeping its type and version */
+    void Acquire(CDataStream& stream);
+    /** Hand back a message's stream; buffers of large payloads are dropped */
+    void Release(CDataStream&& buffer, uint32_t payload_size);
+
+private:
+    Mutex m_mutex;
+    std::vector<CDataStream> m_buffers GUARDED_BY(m_mutex);
+};
+
 /** Transport protocol agnostic message container.
  * Ideally it should only contain receive time, payload,
  * command and size.
@@ -623,8 +711,13 @@ public:
     uint32_t m_message_size = 0;         // size of the payload
     uint32_t m_raw_message_size = 0;     // used wire size of the message (including header/checksum)
     std::string m_command;
+    //! Pool m_recv is returned to on destruction, if any
+    std::shared_ptr<NetMessageBufferPool> m_buffer_pool;
 
-    CNetMessage(CDataStream&& recv_in) : m_recv(std::move(recv_in)) {}
+    CNetMessage(CDataStream&& recv_in, std::shared_ptr<NetMessageBufferPool> buffer_pool = nullptr) : m_recv(std::move(recv_in)), m_buffer_pool(std::move(buffer_pool)) {}
+    CNetMessage(CNetMessage&&) = default;
+    CNetMessage& operator=(CNetMessage&&) = default;
+    ~CNetMessage();
 
     void SetVersion(int nVersionIn)
     {
@@ -658,6 +751,7 @@ private:
     CDataStream hdrbuf;             // partially received header
     CMessageHeader hdr;             // complete header
     CDataStream vRecv;              // received message data
+    std::shared_ptr<NetMessageBufferPool> m_buffer_pool; // recycled vRecv buffers
     unsigned int nHdrPos;
     unsigned int nDataPos;
 
@@ -678,7 +772,7 @@ private:
 
 public:
 
-    V1TransportDeserializer(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
+    V1TransportDeserializer(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn), m_buffer_pool(std::make_shared<NetMessageBufferPool>()) {
         Reset();
     }
 
@@ -732,6 +826,8 @@ public:
     size_t nSendOffset{0}; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes GUARDED_BY(cs_vSend){0};
     std::deque<std::vector<unsigned char>> vSendMsg GUARDED_BY(cs_vSend);
+    //! Whether the socket is currently registered for write readiness (epoll only)
+    bool m_send_events_armed GUARDED_BY(cs_vSend){false};
     RecursiveMutex cs_vSend;
     RecursiveMutex cs_hSocket;
     RecursiveMutex cs_vRecv;
@@ -788,14 +884,19 @@ public:
 protected:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     mapMsgCmdSize mapRecvBytesPerMsgCmd GUARDED_BY(cs_vRecv);
+    Mutex cs_msgProcessingStats;
+    mapMsgCmdProcessingStats mapProcessingStatsPerMsgCmd GUARDED_BY(cs_msgProcessingStats);
 
 public:
     uint256 hashContinue;
     std::atomic<int> nStartingHeight{-1};
 
     // flood relay
-    std::vector<CAddress> vAddrToSend;
-    const std::unique_ptr<CRollingBloomFilter> m_addr_known;
+    // Peers relay addresses to each other from different message handler
+    // threads, so the queue and the known filter are protected by cs_addr_send.
+    RecursiveMutex cs_addr_send;
+    std::vector<CAddress> vAddrToSend GUARDED_BY(cs_addr_send);
+    const std::unique_ptr<CRollingBloomFilter> m_addr_known PT_GUARDED_BY(cs_addr_send);
     bool fGetAddr{false};
     std::chrono::microseconds m_next_addr_send GUARDED_BY(cs_sendProcessing){0};
     std::chrono::microseconds m_next_local_addr_send GUARDED_BY(cs_sendProcessing){0};
@@ -950,6 +1051,7 @@ public:
     void AddAddressKnown(const CAddress& _addr)
     {
         assert(m_addr_known);
+        LOCK(cs_addr_send);
         m_addr_known->insert(_addr.GetKey());
     }
 
@@ -959,6 +1061,7 @@ public:
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
         assert(m_addr_known);
+        LOCK(cs_addr_send);
         if (_addr.IsValid() && !m_addr_known->contains(_addr.GetKey())) {
             if (vAddrToSend.size() >= MAX_ADDR_TO_SEND) {
                 vAddrToSend[insecure_rand.randrange(vAddrToSend.size())] = _addr;
@@ -1000,6 +1103,9 @@ public:
 
     void copyStats(CNodeStats &stats, const std::vector<bool> &m_asmap);
 
+    /** Account the cost of processing one message of type msg_type (which must be a known type or NET_MESSAGE_COMMAND_OTHER). */
+    void RecordMessageProcessing(const std::string& msg_type, int64_t queue_wait_usec, int64_t process_usec, int64_t cs_main_usec);
+
     ServiceFlags GetLocalServices() const
     {
         return nLocalServices;
@@ -11,6 +11,7 @@
 #include <chainparams.h>
 #include <consensus/validation.h>
 #include <hash.h>
+#include <index/blockfilterindex.h>
 #include <validation.h>
 #include <merkleblock.h>
 #include <netmessagemaker.h>
@@ -30,8 +31,11 @@
 #include <shutdown.h>
 #include <checkpoints.h>
 
+#include <array>
+#include <deque>
 #include <memory>
 #include <typeinfo>
+#include <unordered_map>
 
 #if defined(NDEBUG)
 # error "Bitcoin cannot be compiled without assertions."
@@ -83,6 +87,29 @@ static_assert(INBOUND_PEER_TX_DELAY >= MAX_GETDATA_RANDOM_DELAY,
 "To preserve security, MAX_GETDATA_RANDOM_DELAY should not exceed INBOUND_PEER_DELAY");
 /** Limit to avoid sending big packets. Not used in processing incoming GETDATA for compatibility */
 static const unsigned int MAX_GETDATA_SZ = 1000;
+/** Maximum number of orphans accepted or rejected per ProcessOrphanTx call before yielding to other peers */
+static const unsigned int MAX_ORPHAN_TX_RESOLVE_BATCH = 8;
+/** Bounds on the number of blocks in flight from a single peer once its block download throughput is known.
+ *  Until then, MAX_BLOCKS_IN_TRANSIT_PER_PEER is used. */
+static constexpr int MIN_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+static constexpr int MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER = 64;
+/** How much download work (in microseconds, at the peer's measured rate) to keep queued at each peer */
+static constexpr int64_t BLOCK_DOWNLOAD_TARGET_BACKLOG = 4 * 1000000;
+/** A block holding back the download window is requested from a faster peer once it has been outstanding for
+ *  this many times that peer's per-block service time */
+static constexpr int64_t BLOCK_STRAGGLER_FACTOR = 4;
+/** ...and for at least this long (in microseconds), so that fast peers don't bounce requests between each other */
+static constexpr int64_t BLOCK_STRAGGLER_MIN_TIME = 1000000;
+/** Number of blocks at the tip whose network serializations are kept for serving them to peers. Each entry
+ *  holds the deserialized CBlock and up to four serializations: with and without witness (at most
+ *  MAX_BLOCK_SERIALIZED_SIZE and MAX_BLOCK_WEIGHT / WITNESS_SCALE_FACTOR bytes), and the two compact
+ *  forms (6 bytes per transaction). In the worst case of full blocks that is about 10 x (4 MB + 1 MB
+ *  + 2 x 0.1 MB) = 52 MB of serializations, plus the 10 CBlocks. */
+static constexpr int SERIALIZED_BLOCK_CACHE_SIZE = 10;
+/** Maximum number of compact filters that may be requested with one getcfilters. See BIP 157. */
+static constexpr uint32_t MAX_GETCFILTERS_SIZE = 1000;
+/** Maximum number of cf hashes that may be requested with one getcfheaders. See BIP 157. */
+static constexpr uint32_t MAX_GETCFHEADERS_SIZE = 2000;
 
 
 struct COrphanTx {
@@ -91,6 +118,7 @@ struct COrphanTx {
     NodeId fromPeer;
     int64_t nTimeExpire;
     size_t list_pos;
+    size_t nTxSize;
 };
 RecursiveMutex g_cs_orphans;
 std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(g_cs_orphans);
@@ -121,6 +149,8 @@ static const unsigned int INVENTORY_BROADCAST_INTERVAL = 5;
 /** Maximum number of inventory items to send per transmission.
  *  Limits the impact of low-fee transaction floods. */
 static constexpr unsigned int INVENTORY_BROADCAST_MAX = 7 * INVENTORY_BROADCAST_INTERVAL;
+/** How long the relay order looked up for a transaction is reused by the inventory trickles of all peers */
+static constexpr std::chrono::microseconds RELAY_ORDER_REFRESH_INTERVAL{std::chrono::seconds{1}};
 /** Average delay between feefilter broadcasts in seconds. */
 static constexpr unsigned int AVG_FEEFILTER_BROADCAST_INTERVAL = 3 * 60;
 /** Maximum feefilter broadcast delay after significant change. */
@@ -175,6 +205,7 @@ namespace {
         const CBlockIndex* pindex;                               //!< Optional.
         bool fValidatedHeaders;                                  //!< Whether this block has validated headers at the time of request.
         std::unique_ptr<PartiallyDownloadedBlock> partialBlock;  //!< Optional, used for CMPCTBLOCK downloads
+        int64_t nTimeRequested;                                  //!< Time (in microseconds) this block was requested from the peer
     };
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight GUARDED_BY(cs_main);
 
@@ -211,6 +242,14 @@ namespace {
 
     std::vector<std::map<uint256, COrphanTx>::iterator> g_orphan_list GUARDED_BY(g_cs_orphans); //! For random eviction
 
+    /** Orphans announced by a single peer, so they can be erased or evicted without scanning the whole pool. */
+    struct OrphanPeerInfo {
+        std::set<uint256> txids;
+        size_t nBytes = 0;
+    };
+    std::map<NodeId, OrphanPeerInfo> g_orphans_by_peer GUARDED_BY(g_cs_orphans);
+    size_t g_orphan_bytes GUARDED_BY(g_cs_orphans) = 0; //! Total serialized size of all orphans
+
     static size_t vExtraTxnForCompactIt GUARDED_BY(g_cs_orphans) = 0;
     static std::vector<std::pair<uint256, CTransactionRef>> vExtraTxnForCompact GUARDED_BY(g_cs_orphans);
 } // namespace
@@ -339,6 +378,8 @@ struct CNodeState {
     std::list<QueuedBlock> vBlocksInFlight;
     //! When the first entry in vBlocksInFlight started downloading. Don't care when vBlocksInFlight is empty.
     int64_t nDownloadingSince;
+    //! Moving average of the time (in microseconds) this peer takes per block at the head of its download queue, or 0 if unmeasured.
+    int64_t m_block_service_time;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
     //! Whether we consider this a preferred download peer.
@@ -478,6 +519,7 @@ struct CNodeState {
         nHeadersSyncTimeout = 0;
         nStallingSince = 0;
         nDownloadingSince = 0;
+        m_block_service_time = 0;
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
         fPreferredDownload = false;
@@ -589,8 +631,12 @@ static bool MarkBlockAsReceived(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs
             nPeersWithValidatedDownloads--;
         }
         if (state->vBlocksInFlight.begin() == itInFlight->second.second) {
-            // First block on the queue was received, update the start download time for the next one
-            state->nDownloadingSince = std::max(state->nDownloadingSince, GetTimeMicros());
+            // First block on the queue was received (or given up on). The time it spent at the head of the queue
+            // feeds the peer's service time estimate, then update the start download time for the next one.
+            const int64_t now = GetTimeMicros();
+            const int64_t elapsed = std::max<int64_t>(now - state->nDownloadingSince, 1);
+            state->m_block_service_time = state->m_block_service_time == 0 ? elapsed : (state->m_block_service_time * 7 + elapsed) / 8;
+            state->nDownloadingSince = std::max(state->nDownloadingSince, now);
         }
         state->vBlocksInFlight.erase(itInFlight->second.second);
         state->nBlocksInFlight--;
@@ -601,6 +647,20 @@ static bool MarkBlockAsReceived(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs
     return false;
 }
 
+static int GetBlocksInTransitLimit(const CNodeState& state)
+{
+    return ::GetBlocksInTransitLimit(state.m_block_service_time);
+}
+
+static bool ShouldRerequestStalledBlock(const CNodeState& state, const CBlockIndex* pindexStalling, int64_t now) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    const auto it = mapBlocksInFlight.find(pindexStalling->GetBlockHash());
+    if (it == mapBlocksInFlight.end()) {
+        return false;
+    }
+    return ::ShouldRerequestStalledBlock(state.m_block_service_time, it->second.second->nTimeRequested, now);
+}
+
 // returns false, still setting pit, if the block was already in flight from the same peer
 // pit will only be valid as long as the same cs_main lock is being held
 static bool MarkBlockAsInFlight(CTxMemPool& mempool, NodeId nodeid, const uint256& hash, const CBlockIndex* pindex = nullptr, std::list<QueuedBlock>::iterator** pit = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
@@ -620,7 +680,7 @@ static bool MarkBlockAsInFlight(CTxMemPool& mempool, NodeId nodeid, const uint25
     MarkBlockAsReceived(hash);
 
     std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
-            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr)});
+            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr), GetTimeMicros()});
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
     if (state->nBlocksInFlight == 1) {
@@ -738,7 +798,7 @@ static bool PeerHasHeader(CNodeState *state, const CBlockIndex *pindex) EXCLUSIV
 
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
  *  at most count entries. */
-static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const Consensus::Params& consensusParams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const CBlockIndex*& pindexStalling, const Consensus::Params& consensusParams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     if (count == 0)
         return;
@@ -775,6 +835,7 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
     int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
+    const CBlockIndex* pindexWaitingFor = nullptr;
     while (pindexWalk->nHeight < nMaxHeight) {
         // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
         // pindexBestKnownBlock) into vToFetch. We fetch 128, because CBlockIndex::GetAncestor may be as expensive
@@ -810,6 +871,7 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
                     if (vBlocks.size() == 0 && waitingfor != nodeid) {
                         // We aren't able to fetch anything, but we would be if the download window was one larger.
                         nodeStaller = waitingfor;
+                        pindexStalling = pindexWaitingFor;
                     }
                     return;
                 }
@@ -820,6 +882,7 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
             } else if (waitingfor == -1) {
                 // This is the first already-in-flight block.
                 waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                pindexWaitingFor = pindex;
             }
         }
     }
@@ -952,6 +1015,35 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
     LogPrint(BCLog::NET, "Cleared nodestate for peer=%d\n", nodeid);
 }
 
+/**
+ * Number of blocks we are willing to have in flight from a peer. Once we have measured how
+ * quickly it delivers blocks, size the window so that about BLOCK_DOWNLOAD_TARGET_BACKLOG worth
+ * of work is queued: fast peers get deep pipelines, slow peers hold few blocks of the shared
+ * download window hostage.
+ */
+int GetBlocksInTransitLimit(int64_t block_service_time)
+{
+    if (block_service_time == 0) {
+        return MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+    }
+    const int64_t limit = BLOCK_DOWNLOAD_TARGET_BACKLOG / block_service_time;
+    return std::max<int64_t>(MIN_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER, std::min<int64_t>(limit, MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER));
+}
+
+/**
+ * Whether a block that holds back the download window and was requested from another peer at
+ * time_requested should rather be requested from a peer with the given service time. Only move
+ * requests to peers that have proven to be much faster than the staller is currently being.
+ */
+bool ShouldRerequestStalledBlock(int64_t block_service_time, int64_t time_requested, int64_t now)
+{
+    if (block_service_time == 0) {
+        return false;
+    }
+    const int64_t outstanding = now - time_requested;
+    return outstanding > BLOCK_STRAGGLER_MIN_TIME && outstanding > BLOCK_STRAGGLER_FACTOR * block_service_time;
+}
+
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
     LOCK(cs_main);
     CNodeState *state = State(nodeid);
@@ -1003,17 +1095,22 @@ bool AddOrphanTx(const CTransactionRef& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRE
         return false;
     }
 
-    auto ret = mapOrphanTransactions.emplace(hash, COrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME, g_orphan_list.size()});
+    const size_t nTxSize = tx->GetTotalSize();
+    auto ret = mapOrphanTransactions.emplace(hash, COrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME, g_orphan_list.size(), nTxSize});
     assert(ret.second);
     g_orphan_list.push_back(ret.first);
     for (const CTxIn& txin : tx->vin) {
         mapOrphanTransactionsByPrev[txin.prevout].insert(ret.first);
     }
+    OrphanPeerInfo& peer_info = g_orphans_by_peer[peer];
+    peer_info.txids.insert(hash);
+    peer_info.nBytes += nTxSize;
+    g_orphan_bytes += nTxSize;
 
     AddToCompactExtraTransactions(tx);
 
-    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u)\n", hash.ToString(),
-             mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size());
+    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u bytes %u)\n", hash.ToString(),
+             mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size(), g_orphan_bytes);
     return true;
 }
 
@@ -1043,6 +1140,15 @@ int static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
     }
     g_orphan_list.pop_back();
 
+    auto it_peer = g_orphans_by_peer.find(it->second.fromPeer);
+    assert(it_peer != g_orphans_by_peer.end());
+    it_peer->second.txids.erase(hash);
+    it_peer->second.nBytes -= it->second.nTxSize;
+    if (it_peer->second.txids.empty()) {
+        g_orphans_by_peer.erase(it_peer);
+    }
+    g_orphan_bytes -= it->second.nTxSize;
+
     mapOrphanTransactions.erase(it);
     return 1;
 }
@@ -1050,21 +1156,19 @@ int static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
 void EraseOrphansFor(NodeId peer)
 {
     LOCK(g_cs_orphans);
+    auto it_peer = g_orphans_by_peer.find(peer);
+    if (it_peer == g_orphans_by_peer.end()) return;
+    // Copy, as EraseOrphanTx removes the peer entry along with its last orphan
+    const std::set<uint256> txids = it_peer->second.txids;
     int nErased = 0;
-    std::map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
-    while (iter != mapOrphanTransactions.end())
-    {
-        std::map<uint256, COrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
-        if (maybeErase->second.fromPeer == peer)
-        {
-            nErased += EraseOrphanTx(maybeErase->second.tx->GetHash());
-        }
+    for (const uint256& hash : txids) {
+        nErased += EraseOrphanTx(hash);
     }
     if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx from peer=%d\n", nErased, peer);
 }
 
 
-unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
+unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans, size_t nMaxOrphanBytes)
 {
     LOCK(g_cs_orphans);
 
@@ -1090,11 +1194,17 @@ unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
         if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx due to expiration\n", nErased);
     }
     FastRandomContext rng;
-    while (mapOrphanTransactions.size() > nMaxOrphans)
+    while (mapOrphanTransactions.size() > nMaxOrphans || g_orphan_bytes > nMaxOrphanBytes)
     {
-        // Evict a random orphan:
-        size_t randompos = rng.randrange(g_orphan_list.size());
-        EraseOrphanTx(g_orphan_list[randompos]->first);
+        // Evict a random orphan of the peer holding the most orphan bytes, so
+        // a single peer flooding orphans cannot push out everyone else's.
+        auto it_peer = std::max_element(g_orphans_by_peer.begin(), g_orphans_by_peer.end(),
+            [](const std::pair<const NodeId, OrphanPeerInfo>& a, const std::pair<const NodeId, OrphanPeerInfo>& b) {
+                return a.second.nBytes < b.second.nBytes;
+            });
+        assert(it_peer != g_orphans_by_peer.end());
+        const std::set<uint256>& txids = it_peer->second.txids;
+        EraseOrphanTx(*std::next(txids.begin(), rng.randrange(txids.size())));
         ++nEvicted;
     }
     return nEvicted;
@@ -1276,6 +1386,199 @@ PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, BanMan* banman, CS
     scheduler.scheduleEvery([this, consensusParams] { this->CheckForStaleTipAndEvictPeers(consensusParams); }, std::chrono::seconds{EXTRA_PEER_CHECK_INTERVAL});
 }
 
+namespace {
+/**
+ * Relay order of the transactions queued for inventory trickling, shared by all
+ * peers. Rather than every peer's trickle comparing its queue through
+ * CTxMemPool::CompareDepthAndScore (two mempool lookups under mempool.cs per
+ * comparison), the sort key and mempool info of a transaction are looked up once,
+ * in a single mempool.cs section for everything a trickle misses, and reused by all
+ * peers until the order is refreshed every RELAY_ORDER_REFRESH_INTERVAL, or when
+ * a block is connected or disconnected, which changes ancestor counts.
+ * Entries may be stale by then; callers re-check mempool membership of whatever
+ * they actually announce.
+ */
+class TxRelayOrder
+{
+public:
+    struct Entry {
+        TxMempoolInfo info; //!< info.tx is null if the transaction was not in the mempool
+        uint64_t ancestor_count{0};
+    };
+
+    /** Entries for txids, in the same order. They stay valid until the next call. */
+    std::vector<const Entry*> Lookup(const CTxMemPool& mempool, const std::set<uint256>& txids, std::chrono::microseconds now) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+    {
+        if (now >= m_refresh_time || m_invalidated.exchange(false)) {
+            m_entries.clear();
+            m_refresh_time = now + RELAY_ORDER_REFRESH_INTERVAL;
+        }
+        std::vector<uint256> missing;
+        for (const uint256& txid : txids) {
+            if (!m_entries.count(txid)) missing.push_back(txid);
+        }
+        if (!missing.empty()) {
+            LOCK(mempool.cs);
+            for (const uint256& txid : missing) {
+                Entry& entry = m_entries[txid];
+                auto mi = mempool.mapTx.find(txid);
+                if (mi != mempool.mapTx.end()) {
+                    entry.info = TxMempoolInfo{mi->GetSharedTx(), mi->GetTime(), mi->GetFee(), mi->GetTxSize(), mi->GetModifiedFee() - mi->GetFee()};
+                    entry.ancestor_count = mi->GetCountWithAncestors();
+                }
+            }
+        }
+        std::vector<const Entry*> ret;
+        ret.reserve(txids.size());
+        for (const uint256& txid : txids) {
+            ret.push_back(&m_entries.find(txid)->second);
+        }
+        return ret;
+    }
+
+    /** Whether a should be announced before b: parents before children, then by
+     *  modified feerate, like CTxMemPool::CompareDepthAndScore. Both must be in the mempool. */
+    static bool Before(const Entry& a, const Entry& b)
+    {
+        if (a.ancestor_count != b.ancestor_count) {
+            return a.ancestor_count < b.ancestor_count;
+        }
+        double f1 = (double)(a.info.fee + a.info.nFeeDelta) * b.info.vsize;
+        double f2 = (double)(b.info.fee + b.info.nFeeDelta) * a.info.vsize;
+        if (f1 == f2) {
+            return b.info.tx->GetHash() < a.info.tx->GetHash();
+        }
+        return f1 > f2;
+    }
+
+    /** Drop all entries at the next Lookup. Does not require cs_main. */
+    void Invalidate() { m_invalidated = true; }
+
+private:
+    std::unordered_map<uint256, Entry, SaltedTxidHasher> m_entries GUARDED_BY(cs_main);
+    std::chrono::microseconds m_refresh_time GUARDED_BY(cs_main){0};
+    std::atomic<bool> m_invalidated{false};
+};
+
+TxRelayOrder g_tx_relay_order;
+}
+
+namespace {
+/**
+ * Network serializations of the most recent blocks, shared across peers.
+ *
+ * A new block is typically requested by many peers within a few seconds,
+ * each of them wanting the same bytes. Rather than re-serializing the block
+ * (or re-building its compact form) per request, each form is serialized once,
+ * on first use, and the resulting buffer is handed to every peer asking for it.
+ * Entries are dropped when their block is disconnected, or in FIFO order once
+ * more than SERIALIZED_BLOCK_CACHE_SIZE blocks have been added.
+ */
+class SerializedBlockCache
+{
+public:
+    enum Form {
+        BLOCK_WITNESS,
+        BLOCK_NO_WITNESS,
+        CMPCT_WITNESS,
+        CMPCT_NO_WITNESS,
+        FORM_COUNT
+    };
+    typedef std::shared_ptr<const std::vector<unsigned char>> Payload;
+
+    void Add(const std::shared_ptr<const CBlock>& pblock)
+    {
+        const uint256 hash = pblock->GetHash();
+        LOCK(m_mutex);
+        if (m_entries.count(hash)) return;
+        std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+        entry->block = pblock;
+        m_entries.emplace(hash, std::move(entry));
+        m_order.push_back(hash);
+        while (m_order.size() > (size_t)SERIALIZED_BLOCK_CACHE_SIZE) {
+            m_entries.erase(m_order.front());
+            m_order.pop_front();
+        }
+    }
+
+    void Erase(const uint256& hash)
+    {
+        LOCK(m_mutex);
+        if (m_entries.erase(hash)) {
+            m_order.erase(std::find(m_order.begin(), m_order.end(), hash));
+        }
+    }
+
+    std::shared_ptr<const CBlock> GetBlock(const uint256& hash) const
+    {
+        std::shared_ptr<Entry> entry = Find(hash);
+        return entry ? entry->block : nullptr;
+    }
+
+    /** Return the requested serialization of a cached block, or nullptr if the block is not cached. */
+    Payload Get(const uint256& hash, Form form) const
+    {
+        std::shared_ptr<Entry> entry = Find(hash);
+        if (!entry) return nullptr;
+
+        // Serialize outside of m_mutex, so that peers asking for different
+        // blocks don't wait on each other.
+        LOCK(entry->m_mutex);
+        Payload& payload = entry->payloads[form];
+        if (!payload) {
+            std::shared_ptr<std::vector<unsigned char>> data = std::make_shared<std::vector<unsigned char>>();
+            const CBlock& block = *entry->block;
+            switch (form) {
+            case BLOCK_WITNESS:
+                CVectorWriter{SER_NETWORK, PROTOCOL_VERSION, *data, 0, block};
+                break;
+            case BLOCK_NO_WITNESS:
+                CVectorWriter{SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS, *data, 0, block};
+                break;
+            case CMPCT_WITNESS:
+                CVectorWriter{SER_NETWORK, PROTOCOL_VERSION, *data, 0, CBlockHeaderAndShortTxIDs{block, true}};
+                break;
+            case CMPCT_NO_WITNESS:
+                CVectorWriter{SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS, *data, 0, CBlockHeaderAndShortTxIDs{block, false}};
+                break;
+            case FORM_COUNT:
+                assert(false);
+            }
+            payload = std::move(data);
+        }
+        return payload;
+    }
+
+private:
+    struct Entry {
+        Mutex m_mutex;
+        std::shared_ptr<const CBlock> block;
+        std::array<Payload, FORM_COUNT> payloads GUARDED_BY(m_mutex);
+    };
+
+    std::shared_ptr<Entry> Find(const uint256& hash) const
+    {
+        LOCK(m_mutex);
+        auto it = m_entries.find(hash);
+        return it == m_entries.end() ? nullptr : it->second;
+    }
+
+    mutable Mutex m_mutex;
+    std::map<uint256, std::shared_ptr<Entry>> m_entries GUARDED_BY(m_mutex);
+    std::deque<uint256> m_order GUARDED_BY(m_mutex);
+};
+} // namespace
+
+static SerializedBlockCache g_serialized_block_cache;
+
+/** The serialization g_serialized_block_cache holds for a block, or nullptr if it is not cached. Exposed for unit tests. */
+std::shared_ptr<const std::vector<unsigned char>> GetCachedBlockSerialization(const uint256& hash, bool compact, bool witness)
+{
+    const SerializedBlockCache::Form form = compact ? (witness ? SerializedBlockCache::CMPCT_WITNESS : SerializedBlockCache::CMPCT_NO_WITNESS)
+                                                    : (witness ? SerializedBlockCache::BLOCK_WITNESS : SerializedBlockCache::BLOCK_NO_WITNESS);
+    return g_serialized_block_cache.Get(hash, form);
+}
+
 /**
  * Evict orphan txn pool entries (EraseOrphanTx) based on a newly connected
  * block. Also save the time of the last tip update.
@@ -1319,6 +1622,8 @@ void PeerLogicValidation::BlockConnected(const std::shared_ptr<const CBlock>& pb
             g_recent_confirmed_transactions->insert(ptx->GetHash());
         }
     }
+    g_serialized_block_cache.Add(pblock);
+    g_tx_relay_order.Invalidate();
 }
 
 void PeerLogicValidation::BlockDisconnected(const std::shared_ptr<const CBlock> &block, const CBlockIndex* pindex)
@@ -1331,8 +1636,12 @@ void PeerLogicValidation::BlockDisconnected(const std::shared_ptr<const CBlock>
     // block's worth of transactions in it, but that should be fine, since
     // presumably the most common case of relaying a confirmed transaction
     // should be just after a new block containing it is found.
-    LOCK(g_cs_recent_confirmed_transactions);
-    g_recent_confirmed_transactions->reset();
+    {
+        LOCK(g_cs_recent_confirmed_transactions);
+        g_recent_confirmed_transactions->reset();
+    }
+    g_serialized_block_cache.Erase(block->GetHash());
+    g_tx_relay_order.Invalidate();
 }
 
 // All of the following cache a recent block, and are protected by cs_most_recent_block
@@ -1511,6 +1820,17 @@ void RelayTransaction(const uint256& txid, const CConnman& connman)
     });
 }
 
+void RelayTransactions(const std::vector<uint256>& txids, const CConnman& connman)
+{
+    if (txids.empty()) return;
+    connman.ForEachNode([&txids](CNode* pnode)
+    {
+        for (const uint256& txid : txids) {
+            pnode->PushInventory(CInv(MSG_TX, txid));
+        }
+    });
+}
+
 static void RelayAddress(const CAddress& addr, bool fReachable, const CConnman& connman)
 {
     unsigned int nRelayNodes = fReachable ? 2 : 1; // limited relaying of addresses outside our network(s)
@@ -1547,6 +1867,25 @@ static void RelayAddress(const CAddress& addr, bool fReachable, const CConnman&
     connman.ForEachNodeThen(std::move(sortfunc), std::move(pushfunc));
 }
 
+/**
+ * A block we decided to serve could not be read back. Without cs_main held
+ * across the read it may have been pruned (or its index entry cleaned) in the
+ * meantime, in which case the peer is disconnected so it can fetch the block
+ * elsewhere instead of stalling. Otherwise the block store is broken.
+ */
+static void HandleBlockReadFailure(CNode* pfrom, const uint256& hash) LOCKS_EXCLUDED(cs_main)
+{
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pindex = LookupBlockIndex(hash);
+        if (pindex && (pindex->nStatus & BLOCK_HAVE_DATA)) {
+            assert(!"cannot load block from disk");
+        }
+    }
+    LogPrint(BCLog::NET, "Block %s went away while serving it, disconnect peer=%d\n", hash.ToString(), pfrom->GetId());
+    pfrom->fDisconnect = true;
+}
+
 void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, const CInv& inv, CConnman* connman)
 {
     bool send = false;
@@ -1584,122 +1923,161 @@ void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, c
         }
     }
 
-    LOCK(cs_main);
-    const CBlockIndex* pindex = LookupBlockIndex(inv.hash);
-    if (pindex) {
-        send = BlockRequestAllowed(pindex, consensusParams);
-        if (!send) {
-            LogPrint(BCLog::NET, "%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
-        }
-    }
-    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
-    // disconnect node in case we have reached the outbound limit for serving historical blocks
-    // never disconnect whitelisted nodes
-    if (send && connman->OutboundTargetReached(true) && ( ((pindexBestHeader != nullptr) && (pindexBestHeader->GetBlockTime() - pindex->GetBlockTime() > HISTORICAL_BLOCK_AGE)) || inv.type == MSG_FILTERED_BLOCK) && !pfrom->HasPermission(PF_NOBAN))
+    // Decide whether and what to send under cs_main, but read the block from
+    // disk and serialize it without holding it, so that serving historical
+    // blocks to one peer does not stall the message handlers of others.
+    // Block index entries may be erased once cs_main is released (see
+    // CleanBlockIndex), so only copies of what is needed are kept.
+    FlatFilePos block_pos;
+    bool fPeerWantsWitness = false;
+    bool fSendCompact = false;
+    bool fCacheable = false;
+    uint256 hashTip;
     {
-        LogPrint(BCLog::NET, "historical block serving limit reached, disconnect peer=%d\n", pfrom->GetId());
+        LOCK(cs_main);
+        const CBlockIndex* pindex = LookupBlockIndex(inv.hash);
+        if (pindex) {
+            send = BlockRequestAllowed(pindex, consensusParams);
+            if (!send) {
+                LogPrint(BCLog::NET, "%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
+            }
+        }
+        // disconnect node in case we have reached the outbound limit for serving historical blocks
+        // never disconnect whitelisted nodes
+        if (send && connman->OutboundTargetReached(true) && ( ((pindexBestHeader != nullptr) && (pindexBestHeader->GetBlockTime() - pindex->GetBlockTime() > HISTORICAL_BLOCK_AGE)) || inv.type == MSG_FILTERED_BLOCK) && !pfrom->HasPermission(PF_NOBAN))
+        {
+            LogPrint(BCLog::NET, "historical block serving limit reached, disconnect peer=%d\n", pfrom->GetId());
 
-        //disconnect node
-        pfrom->fDisconnect = true;
-        send = false;
-    }
-    // Avoid leaking prune-height by never sending blocks below the NODE_NETWORK_LIMITED threshold
-    if (send && !pfrom->HasPermission(PF_NOBAN) && (
-            (((pfrom->GetLocalServices() & NODE_NETWORK_LIMITED) == NODE_NETWORK_LIMITED) && ((pfrom->GetLocalServices() & NODE_NETWORK) != NODE_NETWORK) && (::ChainActive().Tip()->nHeight - pindex->nHeight > (int)NODE_NETWORK_LIMITED_MIN_BLOCKS + 2 /* add two blocks buffer extension for possible races */) )
-       )) {
-        LogPrint(BCLog::NET, "Ignore block request below NODE_NETWORK_LIMITED threshold from peer=%d\n", pfrom->GetId());
+            //disconnect node
+            pfrom->fDisconnect = true;
+            send = false;
+        }
+        // Avoid leaking prune-height by never sending blocks below the NODE_NETWORK_LIMITED threshold
+        if (send && !pfrom->HasPermission(PF_NOBAN) && (
+                (((pfrom->GetLocalServices() & NODE_NETWORK_LIMITED) == NODE_NETWORK_LIMITED) && ((pfrom->GetLocalServices() & NODE_NETWORK) != NODE_NETWORK) && (::ChainActive().Tip()->nHeight - pindex->nHeight > (int)NODE_NETWORK_LIMITED_MIN_BLOCKS + 2 /* add two blocks buffer extension for possible races */) )
+           )) {
+            LogPrint(BCLog::NET, "Ignore block request below NODE_NETWORK_LIMITED threshold from peer=%d\n", pfrom->GetId());
 
-        //disconnect node and prevent it from stalling (would otherwise wait for the missing block)
-        pfrom->fDisconnect = true;
-        send = false;
+            //disconnect node and prevent it from stalling (would otherwise wait for the missing block)
+            pfrom->fDisconnect = true;
+            send = false;
+        }
+        // Pruned nodes may have deleted the block, so check whether
+        // it's available before trying to send.
+        if (!send || !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            return;
+        }
+        block_pos = pindex->GetBlockPos();
+        fCacheable = pindex->nHeight > ::ChainActive().Height() - SERIALIZED_BLOCK_CACHE_SIZE;
+        if (inv.type == MSG_CMPCT_BLOCK) {
+            fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
+            fSendCompact = CanDirectFetch(consensusParams) && pindex->nHeight >= ::ChainActive().Height() - MAX_CMPCTBLOCK_DEPTH;
+        }
+        hashTip = ::ChainActive().Tip()->GetBlockHash();
+    } // release cs_main before reading the block
+
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    // Push the requested form of a block near the tip from the serialized block cache
+    auto push_cached = [&](SerializedBlockCache::Form form, const char* msg_type) {
+        if (!fCacheable) return false;
+        SerializedBlockCache::Payload payload = g_serialized_block_cache.Get(inv.hash, form);
+        if (!payload) return false;
+        connman->PushMessage(pfrom, msgMaker.Make(msg_type, MakeSpan(*payload)));
+        return true;
+    };
+    std::shared_ptr<const CBlock> pblock;
+    if (a_recent_block && a_recent_block->GetHash() == inv.hash) {
+        pblock = a_recent_block;
+    } else if (fCacheable && (pblock = g_serialized_block_cache.GetBlock(inv.hash))) {
+        // Served from the cache below
+    } else if (inv.type == MSG_WITNESS_BLOCK && !fCacheable) {
+        // Fast-path: in this case it is possible to serve the block directly from disk,
+        // as the network format matches the format on disk
+        std::vector<uint8_t> block_data;
+        if (!ReadRawBlockFromDisk(block_data, block_pos, chainparams.MessageStart())) {
+            HandleBlockReadFailure(pfrom, inv.hash);
+            return;
+        }
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, MakeSpan(block_data)));
+        // Don't set pblock as we've sent the block
+    } else {
+        // Send block from disk
+        std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+        if (!ReadBlockFromDisk(*pblockRead, block_pos, consensusParams) || pblockRead->GetHash() != inv.hash) {
+            HandleBlockReadFailure(pfrom, inv.hash);
+            return;
+        }
+        pblock = pblockRead;
     }
-    // Pruned nodes may have deleted the block, so check whether
-    // it's available before trying to send.
-    if (send && (pindex->nStatus & BLOCK_HAVE_DATA))
-    {
-        std::shared_ptr<const CBlock> pblock;
-        if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
-            pblock = a_recent_block;
-        } else if (inv.type == MSG_WITNESS_BLOCK) {
-            // Fast-path: in this case it is possible to serve the block directly from disk,
-            // as the network format matches the format on disk
-            std::vector<uint8_t> block_data;
-            if (!ReadRawBlockFromDisk(block_data, pindex, chainparams.MessageStart())) {
-                assert(!"cannot load block from disk");
-            }
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, MakeSpan(block_data)));
-            // Don't set pblock as we've sent the block
-        } else {
-            // Send block from disk
-            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
-            if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams))
-                assert(!"cannot load block from disk");
-            pblock = pblockRead;
-        }
-        if (pblock) {
-            if (inv.type == MSG_BLOCK)
+    if (pblock) {
+        if (fCacheable) {
+            g_serialized_block_cache.Add(pblock);
+        }
+        if (inv.type == MSG_BLOCK) {
+            if (!push_cached(SerializedBlockCache::BLOCK_NO_WITNESS, NetMsgType::BLOCK))
                 connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
-            else if (inv.type == MSG_WITNESS_BLOCK)
+        }
+        else if (inv.type == MSG_WITNESS_BLOCK) {
+            if (!push_cached(SerializedBlockCache::BLOCK_WITNESS, NetMsgType::BLOCK))
                 connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
-            else if (inv.type == MSG_FILTERED_BLOCK)
-            {
-                bool sendMerkleBlock = false;
-                CMerkleBlock merkleBlock;
-                if (pfrom->m_tx_relay != nullptr) {
-                    LOCK(pfrom->m_tx_relay->cs_filter);
-                    if (pfrom->m_tx_relay->pfilter) {
-                        sendMerkleBlock = true;
-                        merkleBlock = CMerkleBlock(*pblock, *pfrom->m_tx_relay->pfilter);
-                    }
-                }
-                if (sendMerkleBlock) {
-                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
-                    // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
-                    // This avoids hurting performance by pointlessly requiring a round-trip
-                    // Note that there is currently no way for a node to request any single transactions we didn't send here -
-                    // they must either disconnect and retry or request the full block.
-                    // Thus, the protocol spec specified allows for us to provide duplicate txn here,
-                    // however we MUST always provide at least what the remote peer needs
-                    typedef std::pair<unsigned int, uint256> PairType;
-                    for (PairType& pair : merkleBlock.vMatchedTxn)
-                        connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, *pblock->vtx[pair.first]));
+        }
+        else if (inv.type == MSG_FILTERED_BLOCK)
+        {
+            bool sendMerkleBlock = false;
+            CMerkleBlock merkleBlock;
+            if (pfrom->m_tx_relay != nullptr) {
+                LOCK(pfrom->m_tx_relay->cs_filter);
+                if (pfrom->m_tx_relay->pfilter) {
+                    sendMerkleBlock = true;
+                    merkleBlock = CMerkleBlock(*pblock, *pfrom->m_tx_relay->pfilter);
                 }
-                // else
-                    // no response
             }
-            else if (inv.type == MSG_CMPCT_BLOCK)
-            {
-                // If a peer is asking for old blocks, we're almost guaranteed
-                // they won't have a useful mempool to match against a compact block,
-                // and we don't feel like constructing the object for them, so
-                // instead we respond with the full, non-compact block.
-                bool fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
-                int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
-                if (CanDirectFetch(consensusParams) && pindex->nHeight >= ::ChainActive().Height() - MAX_CMPCTBLOCK_DEPTH) {
-                    if ((fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) && a_recent_compact_block && a_recent_compact_block->header.GetHash() == pindex->GetBlockHash()) {
-                        connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
-                    } else {
-                        CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
-                        connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
-                    }
-                } else {
-                    connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock));
-                }
+            if (sendMerkleBlock) {
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
+                // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
+                // This avoids hurting performance by pointlessly requiring a round-trip
+                // Note that there is currently no way for a node to request any single transactions we didn't send here -
+                // they must either disconnect and retry or request the full block.
+                // Thus, the protocol spec specified allows for us to provide duplicate txn here,
+                // however we MUST always provide at least what the remote peer needs
+                typedef std::pair<unsigned int, uint256> PairType;
+                for (PairType& pair : merkleBlock.vMatchedTxn)
+                    connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, *pblock->vtx[pair.first]));
             }
+            // else
+                // no response
         }
-
-        // Trigger the peer node to send a getblocks request for the next batch of inventory
-        if (inv.hash == pfrom->hashContinue)
+        else if (inv.type == MSG_CMPCT_BLOCK)
         {
-            // Bypass PushInventory, this must send even if redundant,
-            // and we want it right after the last block so they don't
-            // wait for other stuff first.
-            std::vector<CInv> vInv;
-            vInv.push_back(CInv(MSG_BLOCK, ::ChainActive().Tip()->GetBlockHash()));
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::INV, vInv));
-            pfrom->hashContinue.SetNull();
+            // If a peer is asking for old blocks, we're almost guaranteed
+            // they won't have a useful mempool to match against a compact block,
+            // and we don't feel like constructing the object for them, so
+            // instead we respond with the full, non-compact block.
+            int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
+            if (fSendCompact) {
+                if ((fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) && a_recent_compact_block && a_recent_compact_block->header.GetHash() == inv.hash) {
+                    connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
+                } else if (!push_cached(fPeerWantsWitness ? SerializedBlockCache::CMPCT_WITNESS : SerializedBlockCache::CMPCT_NO_WITNESS, NetMsgType::CMPCTBLOCK)) {
+                    CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
+                    connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
+                }
+            } else if (!push_cached(fPeerWantsWitness ? SerializedBlockCache::BLOCK_WITNESS : SerializedBlockCache::BLOCK_NO_WITNESS, NetMsgType::BLOCK)) {
+                connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock));
+            }
         }
     }
+
+    // Trigger the peer node to send a getblocks request for the next batch of inventory
+    if (inv.hash == pfrom->hashContinue)
+    {
+        // Bypass PushInventory, this must send even if redundant,
+        // and we want it right after the last block so they don't
+        // wait for other stuff first.
+        std::vector<CInv> vInv;
+        vInv.push_back(CInv(MSG_BLOCK, hashTip));
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::INV, vInv));
+        pfrom->hashContinue.SetNull();
+    }
 }
 
 void static ProcessGetData(CNode* pfrom, const CChainParams& chainparams, CConnman* connman, const CTxMemPool& mempool, const std::atomic<bool>& interruptMsgProc) LOCKS_EXCLUDED(cs_main)
@@ -1921,7 +2299,8 @@ bool static ProcessHeadersMessage(CNode* pfrom, CConnman* connman, CTxMemPool& m
             std::vector<const CBlockIndex*> vToFetch;
             const CBlockIndex *pindexWalk = pindexLast;
             // Calculate all the blocks we'd need to switch to pindexLast, up to a limit.
-            while (pindexWalk && !::ChainActive().Contains(pindexWalk) && vToFetch.size() <= MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+            const int nBlocksInTransitLimit = GetBlocksInTransitLimit(*nodestate);
+            while (pindexWalk && !::ChainActive().Contains(pindexWalk) && vToFetch.size() <= (size_t)nBlocksInTransitLimit) {
                 if (!(pindexWalk->nStatus & BLOCK_HAVE_DATA) &&
                         !mapBlocksInFlight.count(pindexWalk->GetBlockHash()) &&
                         (!IsWitnessEnabled(pindexWalk->pprev, chainparams.GetConsensus()) || State(pfrom->GetId())->fHaveWitness)) {
@@ -1942,7 +2321,7 @@ bool static ProcessHeadersMessage(CNode* pfrom, CConnman* connman, CTxMemPool& m
                 std::vector<CInv> vGetData;
                 // Download as much as possible, from earliest to latest.
                 for (const CBlockIndex *pindex : reverse_iterate(vToFetch)) {
-                    if (nodestate->nBlocksInFlight >= MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+                    if (nodestate->nBlocksInFlight >= nBlocksInTransitLimit) {
                         // Can't download any more from this peer
                         break;
                     }
@@ -2007,8 +2386,8 @@ void static ProcessOrphanTx(CConnman* connman, CTxMemPool& mempool, std::set<uin
     AssertLockHeld(cs_main);
     AssertLockHeld(g_cs_orphans);
     std::set<NodeId> setMisbehaving;
-    bool done = false;
-    while (!done && !orphan_work_set.empty()) {
+    unsigned int nResolved = 0;
+    while (nResolved < MAX_ORPHAN_TX_RESOLVE_BATCH && !orphan_work_set.empty()) {
         const uint256 orphanHash = *orphan_work_set.begin();
         orphan_work_set.erase(orphan_work_set.begin());
 
@@ -2036,7 +2415,7 @@ void static ProcessOrphanTx(CConnman* connman, CTxMemPool& mempool, std::set<uin
                 }
             }
             EraseOrphanTx(orphanHash);
-            done = true;
+            ++nResolved;
         } else if (orphan_state.GetResult() != TxValidationResult::TX_MISSING_INPUTS) {
             if (orphan_state.IsInvalid()) {
                 // Punish peer that gave us an invalid orphan tx
@@ -2056,12 +2435,221 @@ void static ProcessOrphanTx(CConnman* connman, CTxMemPool& mempool, std::set<uin
                 recentRejects->insert(orphanHash);
             }
             EraseOrphanTx(orphanHash);
-            done = true;
+            ++nResolved;
         }
         mempool.check(&::ChainstateActive().CoinsTip());
     }
 }
 
+/**
+ * Validation logic for compact filters request handling.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   filter_type     The filter type the request is for. Must be basic filters.
+ * @param[in]   start_height    The start height for the request
+ * @param[in]   stop_hash       The stop_hash for the request
+ * @param[in]   max_height_diff The maximum number of items permitted to request, as specified in BIP 157
+ * @param[out]  stop_index      The CBlockIndex for the stop_hash block, if the request can be serviced.
+ * @param[out]  filter_index    The filter index, if the request can be serviced.
+ * @return                      True if the request can be serviced.
+ */
+static bool PrepareBlockFilterRequest(CNode* pfrom, BlockFilterType filter_type, uint32_t start_height,
+                                      const uint256& stop_hash, uint32_t max_height_diff,
+                                      const CBlockIndex*& stop_index,
+                                      BlockFilterIndex*& filter_index)
+{
+    const bool supported_filter_type =
+        (filter_type == BlockFilterType::BASIC &&
+         (pfrom->GetLocalServices() & NODE_COMPACT_FILTERS));
+    if (!supported_filter_type) {
+        LogPrint(BCLog::NET, "peer %d requested unsupported block filter type: %d\n",
+                 pfrom->GetId(), static_cast<uint8_t>(filter_type));
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
+        stop_index = LookupBlockIndex(stop_hash);
+
+        // Check that the stop block exists and is on the active chain. Index entries of blocks
+        // off the active chain may be erased by CleanBlockIndex once cs_main is released, so
+        // filters are only served for the active chain.
+        if (!stop_index || !::ChainActive().Contains(stop_index)) {
+            LogPrint(BCLog::NET, "peer %d requested invalid block hash: %s\n",
+                     pfrom->GetId(), stop_hash.ToString());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+    }
+
+    uint32_t stop_height = stop_index->nHeight;
+    if (start_height > stop_height) {
+        LogPrint(BCLog::NET, "peer %d sent invalid getcfilters/getcfheaders with " /* Continued */
+                 "start height %d and stop height %d\n",
+                 pfrom->GetId(), start_height, stop_height);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    if (stop_height - start_height >= max_height_diff) {
+        LogPrint(BCLog::NET, "peer %d requested too many cfilters/cfheaders: %d / %d\n",
+                 pfrom->GetId(), stop_height - start_height + 1, max_height_diff);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    filter_index = GetBlockFilterIndex(filter_type);
+    if (!filter_index) {
+        LogPrint(BCLog::NET, "Filter index for supported type %s not found\n", BlockFilterTypeName(filter_type));
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Handle a cfilters request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFilters(CNode* pfrom, CDataStream& vRecv, CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, filter_type, start_height, stop_hash,
+                                   MAX_GETCFILTERS_SIZE, stop_index, filter_index)) {
+        return;
+    }
+
+    std::vector<BlockFilter> filters;
+    if (!filter_index->LookupFilterRange(start_height, stop_index, filters)) {
+        LogPrint(BCLog::NET, "Failed to find block filter in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                     BlockFilterTypeName(filter_type), start_height, stop_hash.ToString());
+        return;
+    }
+
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    for (const auto& filter : filters) {
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CFILTER, filter));
+    }
+}
+
+/**
+ * Handle a cfheaders request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFHeaders(CNode* pfrom, CDataStream& vRecv, CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, filter_type, start_height, stop_hash,
+                                   MAX_GETCFHEADERS_SIZE, stop_index, filter_index)) {
+        return;
+    }
+
+    uint256 prev_header;
+    if (start_height > 0) {
+        const CBlockIndex* const prev_block =
+            stop_index->GetAncestor(static_cast<int>(start_height - 1));
+        if (!filter_index->LookupFilterHeader(prev_block, prev_header)) {
+            LogPrint(BCLog::NET, "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                         BlockFilterTypeName(filter_type), prev_block->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    std::vector<uint256> filter_hashes;
+    if (!filter_index->LookupFilterHashRange(start_height, stop_index, filter_hashes)) {
+        LogPrint(BCLog::NET, "Failed to find block filter hashes in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                     BlockFilterTypeName(filter_type), start_height, stop_hash.ToString());
+        return;
+    }
+
+    CSerializedNetMsg msg = CNetMsgMaker(pfrom->GetSendVersion())
+        .Make(NetMsgType::CFHEADERS,
+              filter_type_ser,
+              stop_index->GetBlockHash(),
+              prev_header,
+              filter_hashes);
+    connman->PushMessage(pfrom, std::move(msg));
+}
+
+/**
+ * Handle a getcfcheckpt request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFCheckPt(CNode* pfrom, CDataStream& vRecv, CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, filter_type, /*start_height=*/0, stop_hash,
+                                   /*max_height_diff=*/std::numeric_limits<uint32_t>::max(),
+                                   stop_index, filter_index)) {
+        return;
+    }
+
+    std::vector<uint256> headers(stop_index->nHeight / CFCHECKPT_INTERVAL);
+
+    // Populate headers.
+    const CBlockIndex* block_index = stop_index;
+    for (int i = headers.size() - 1; i >= 0; i--) {
+        int height = (i + 1) * CFCHECKPT_INTERVAL;
+        block_index = block_index->GetAncestor(height);
+
+        if (!filter_index->LookupFilterHeader(block_index, headers[i])) {
+            LogPrint(BCLog::NET, "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                         BlockFilterTypeName(filter_type), block_index->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    CSerializedNetMsg msg = CNetMsgMaker(pfrom->GetSendVersion())
+        .Make(NetMsgType::CFCHECKPT,
+              filter_type_ser,
+              stop_index->GetBlockHash(),
+              headers);
+    connman->PushMessage(pfrom, std::move(msg));
+}
+
 bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, CTxMemPool& mempool, CConnman* connman, BanMan* banman, const std::atomic<bool>& interruptMsgProc)
 {
     LogPrint(BCLog::NET, "received: %s (%u bytes) peer=%d\n", SanitizeString(msg_type), vRecv.size(), pfrom->GetId());
@@ -2731,7 +3319,8 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
 
                 // DoS prevention: do not allow mapOrphanTransactions to grow unbounded (see CVE-2012-3789)
                 unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-                unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
+                size_t nMaxOrphanBytes = std::max((int64_t)0, gArgs.GetArg("-maxorphantxsize", DEFAULT_MAX_ORPHAN_TRANSACTIONS_SIZE)) * 1000;
+                unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx, nMaxOrphanBytes);
                 if (nEvicted > 0) {
                     LogPrint(BCLog::MEMPOOL, "mapOrphan overflow, removed %u tx\n", nEvicted);
                 }
@@ -2897,7 +3486,7 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
         // We want to be a bit conservative just to be extra careful about DoS
         // possibilities in compact block processing...
         if (pindex->nHeight <= ::ChainActive().Height() + 2) {
-            if ((!fAlreadyInFlight && nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) ||
+            if ((!fAlreadyInFlight && nodestate->nBlocksInFlight < GetBlocksInTransitLimit(*nodestate)) ||
                  (fAlreadyInFlight && blockInFlightIt->second.first == pfrom->GetId())) {
                 std::list<QueuedBlock>::iterator* queuedBlockIt = nullptr;
                 if (!MarkBlockAsInFlight(mempool, pfrom->GetId(), pindex->GetBlockHash(), pindex, &queuedBlockIt)) {
@@ -3187,7 +3776,7 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
         }
         pfrom->fSentAddr = true;
 
-        pfrom->vAddrToSend.clear();
+        WITH_LOCK(pfrom->cs_addr_send, pfrom->vAddrToSend.clear());
         std::vector<CAddress> vAddr = connman->GetAddresses();
         FastRandomContext insecure_rand;
         for (const CAddress &addr : vAddr) {
@@ -3372,13 +3961,28 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
         return true;
     }
 
+    if (msg_type == NetMsgType::GETCFILTERS) {
+        ProcessGetCFilters(pfrom, vRecv, connman);
+        return true;
+    }
+
+    if (msg_type == NetMsgType::GETCFHEADERS) {
+        ProcessGetCFHeaders(pfrom, vRecv, connman);
+        return true;
+    }
+
+    if (msg_type == NetMsgType::GETCFCHECKPT) {
+        ProcessGetCFCheckPt(pfrom, vRecv, connman);
+        return true;
+    }
+
     if (msg_type == NetMsgType::NOTFOUND) {
         // Remove the NOTFOUND transactions from the peer
         LOCK(cs_main);
         CNodeState *state = State(pfrom->GetId());
         std::vector<CInv> vInv;
         vRecv >> vInv;
-        if (vInv.size() <= MAX_PEER_TX_IN_FLIGHT + MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        if (vInv.size() <= MAX_PEER_TX_IN_FLIGHT + MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER) {
             for (CInv &inv : vInv) {
                 if (inv.type == MSG_TX || inv.type == MSG_WITNESS_TX) {
                     // If we receive a NOTFOUND message for a txid we requested, erase
@@ -3511,6 +4115,8 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
 
     // Process message
     bool fRet = false;
+    const int64_t nProcessStart = GetTimeMicros();
+    const int64_t nCsMainHeldStart = cs_main.GetThreadHeldTime();
     try
     {
         fRet = ProcessMessage(pfrom, msg_type, vRecv, msg.m_time, chainparams, m_mempool, connman, m_banman, interruptMsgProc);
@@ -3523,6 +4129,8 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     } catch (...) {
         LogPrint(BCLog::NET, "%s(%s, %u bytes): Unknown exception caught\n", __func__, SanitizeString(msg_type), nMessageSize);
     }
+    connman->RecordMessageProcessing(pfrom, msg_type, nProcessStart - msg.m_time, GetTimeMicros() - nProcessStart,
+                                     cs_main.GetThreadHeldTime() - nCsMainHeldStart);
 
     if (!fRet) {
         LogPrint(BCLog::NET, "%s(%s, %u bytes) FAILED peer=%d\n", __func__, SanitizeString(msg_type), nMessageSize, pfrom->GetId());
@@ -3669,25 +4277,6 @@ void PeerLogicValidation::CheckForStaleTipAndEvictPeers(const Consensus::Params
     }
 }
 
-namespace {
-class CompareInvMempoolOrder
-{
-    CTxMemPool *mp;
-public:
-    explicit CompareInvMempoolOrder(CTxMemPool *_mempool)
-    {
-        mp = _mempool;
-    }
-
-    bool operator()(std::set<uint256>::iterator a, std::set<uint256>::iterator b)
-    {
-        /* As std::make_heap produces a max-heap, we want the entries with the
-         * fewest ancestors/highest fee to sort later. */
-        return mp->CompareDepthAndScore(*b, *a);
-    }
-};
-}
-
 bool PeerLogicValidation::SendMessages(CNode* pto)
 {
     const Consensus::Params& consensusParams = Params().GetConsensus();
@@ -3728,7 +4317,9 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
             }
         }
 
-        TRY_LOCK(cs_main, lockMain);
+        // With a single message handler thread, skip the peer until the next wake if cs_main is
+        // busy. With several, it is often held by a sibling worker, so wait for it instead.
+        DebugLock<RecursiveMutex> lockMain(cs_main, "cs_main", __FILE__, __LINE__, /* fTry */ connman->GetMsgProcThreads() == 1);
         if (!lockMain)
             return true;
 
@@ -3751,28 +4342,28 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
         if (pto->IsAddrRelayPeer() && pto->m_next_addr_send < current_time) {
             pto->m_next_addr_send = PoissonNextSend(current_time, AVG_ADDRESS_BROADCAST_INTERVAL);
             std::vector<CAddress> vAddr;
-            vAddr.reserve(pto->vAddrToSend.size());
-            assert(pto->m_addr_known);
-            for (const CAddress& addr : pto->vAddrToSend)
             {
-                if (!pto->m_addr_known->contains(addr.GetKey()))
+                LOCK(pto->cs_addr_send);
+                vAddr.reserve(pto->vAddrToSend.size());
+                assert(pto->m_addr_known);
+                for (const CAddress& addr : pto->vAddrToSend)
                 {
-                    pto->m_addr_known->insert(addr.GetKey());
-                    vAddr.push_back(addr);
-                    // receiver rejects addr messages larger than 1000
-                    if (vAddr.size() >= 1000)
+                    if (!pto->m_addr_known->contains(addr.GetKey()))
                     {
-                        connman->PushMessage(pto, msgMaker.Make(NetMsgType::ADDR, vAddr));
-                        vAddr.clear();
+                        pto->m_addr_known->insert(addr.GetKey());
+                        vAddr.push_back(addr);
                     }
                 }
+                pto->vAddrToSend.clear();
+                // we only send the big addr message once
+                if (pto->vAddrToSend.capacity() > 40)
+                    pto->vAddrToSend.shrink_to_fit();
+            }
+            // receiver rejects addr messages larger than 1000
+            for (size_t nStart = 0; nStart < vAddr.size(); nStart += 1000) {
+                const size_t nEnd = std::min(vAddr.size(), nStart + 1000);
+                connman->PushMessage(pto, msgMaker.Make(NetMsgType::ADDR, std::vector<CAddress>(vAddr.begin() + nStart, vAddr.begin() + nEnd)));
             }
-            pto->vAddrToSend.clear();
-            if (!vAddr.empty())
-                connman->PushMessage(pto, msgMaker.Make(NetMsgType::ADDR, vAddr));
-            // we only send the big addr message once
-            if (pto->vAddrToSend.capacity() > 40)
-                pto->vAddrToSend.shrink_to_fit();
         }
 
         // Start block sync
@@ -4012,46 +4603,50 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
 
                 // Determine transactions to relay
                 if (fSendTrickle) {
-                    // Produce a vector with all candidates for sending
-                    std::vector<std::set<uint256>::iterator> vInvTx;
-                    vInvTx.reserve(pto->m_tx_relay->setInventoryTxToSend.size());
-                    for (std::set<uint256>::iterator it = pto->m_tx_relay->setInventoryTxToSend.begin(); it != pto->m_tx_relay->setInventoryTxToSend.end(); it++) {
-                        vInvTx.push_back(it);
-                    }
+                    std::set<uint256>& setInventoryTxToSend = pto->m_tx_relay->setInventoryTxToSend;
+                    const std::vector<const TxRelayOrder::Entry*> vEntries = g_tx_relay_order.Lookup(m_mempool, setInventoryTxToSend, current_time);
                     CFeeRate filterrate;
                     {
                         LOCK(pto->m_tx_relay->cs_feeFilter);
                         filterrate = CFeeRate(pto->m_tx_relay->minFeeFilter);
                     }
+                    // Produce a vector with all candidates for sending, dropping in the same pass what the
+                    // peer already knows, what is not in the mempool anymore and what is below the peer's feefilter.
+                    typedef std::pair<const TxRelayOrder::Entry*, std::set<uint256>::iterator> InvCandidate;
+                    std::vector<InvCandidate> vInvTx;
+                    vInvTx.reserve(vEntries.size());
+                    std::set<uint256>::iterator it = setInventoryTxToSend.begin();
+                    for (const TxRelayOrder::Entry* entry : vEntries) {
+                        const std::set<uint256>::iterator cur = it++;
+                        if (pto->m_tx_relay->filterInventoryKnown.contains(*cur) || !entry->info.tx ||
+                            entry->info.fee < filterrate.GetFee(entry->info.vsize)) {
+                            setInventoryTxToSend.erase(cur);
+                            continue;
+                        }
+                        vInvTx.emplace_back(entry, cur);
+                    }
                     // Topologically and fee-rate sort the inventory we send for privacy and priority reasons.
                     // A heap is used so that not all items need sorting if only a few are being sent.
-                    CompareInvMempoolOrder compareInvMempoolOrder(&m_mempool);
-                    std::make_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
+                    // As std::make_heap produces a max-heap, entries to be announced first must sort later.
+                    auto compareInvRelayOrder = [](const InvCandidate& a, const InvCandidate& b) {
+                        return TxRelayOrder::Before(*b.first, *a.first);
+                    };
+                    std::make_heap(vInvTx.begin(), vInvTx.end(), compareInvRelayOrder);
                     // No reason to drain out at many times the network's capacity,
                     // especially since we have many peers and some will draw much shorter delays.
                     unsigned int nRelayedTransactions = 0;
                     LOCK(pto->m_tx_relay->cs_filter);
                     while (!vInvTx.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
                         // Fetch the top element from the heap
-                        std::pop_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
-                        std::set<uint256>::iterator it = vInvTx.back();
-                        vInvTx.pop_back();
-                        uint256 hash = *it;
+                        std::pop_heap(vInvTx.begin(), vInvTx.end(), compareInvRelayOrder);
+                        const TxMempoolInfo& txinfo = vInvTx.back().first->info;
                         // Remove it from the to-be-sent set
-                        pto->m_tx_relay->setInventoryTxToSend.erase(it);
-                        // Check if not in the filter already
-                        if (pto->m_tx_relay->filterInventoryKnown.contains(hash)) {
-                            continue;
-                        }
-                        // Not in the mempool anymore? don't bother sending it.
-                        auto txinfo = m_mempool.info(hash);
-                        if (!txinfo.tx) {
-                            continue;
-                        }
-                        // Peer told you to not send transactions at that feerate? Don't bother sending it.
-                        if (txinfo.fee < filterrate.GetFee(txinfo.vsize)) {
-                            continue;
-                        }
+                        setInventoryTxToSend.erase(vInvTx.back().second);
+                        vInvTx.pop_back();
+                        const uint256& hash = txinfo.tx->GetHash();
+                        // The shared relay order may be up to RELAY_ORDER_REFRESH_INTERVAL old; don't
+                        // announce (and serve from mapRelay) what was mined, replaced or evicted since.
+                        if (!m_mempool.exists(hash)) continue;
                         if (pto->m_tx_relay->pfilter && !pto->m_tx_relay->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
                         // Send
                         vInv.push_back(CInv(MSG_TX, hash));
@@ -4064,7 +4659,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                                 vRelayExpiration.pop_front();
                             }
 
-                            auto ret = mapRelay.insert(std::make_pair(hash, std::move(txinfo.tx)));
+                            auto ret = mapRelay.insert(std::make_pair(hash, txinfo.tx));
                             if (ret.second) {
                                 vRelayExpiration.push_back(std::make_pair(nNow + std::chrono::microseconds{RELAY_TX_CACHE_TIME}.count(), ret.first));
                             }
@@ -4149,10 +4744,12 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
         // Message: getdata (blocks)
         //
         std::vector<CInv> vGetData;
-        if (!pto->fClient && ((fFetch && !pto->m_limited_node) || !::ChainstateActive().IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        const int nBlocksInTransitLimit = GetBlocksInTransitLimit(state);
+        if (!pto->fClient && ((fFetch && !pto->m_limited_node) || !::ChainstateActive().IsInitialBlockDownload()) && state.nBlocksInFlight < nBlocksInTransitLimit) {
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            const CBlockIndex* pindexStalling = nullptr;
+            FindNextBlocksToDownload(pto->GetId(), nBlocksInTransitLimit - state.nBlocksInFlight, vToDownload, staller, pindexStalling, consensusParams);
             for (const CBlockIndex *pindex : vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(pto);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
@@ -4160,6 +4757,17 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                 LogPrint(BCLog::NET, "Requesting block %s (%d) peer=%d\n", pindex->GetBlockHash().ToString(),
                     pindex->nHeight, pto->GetId());
             }
+            if (staller != -1 && pindexStalling != nullptr && ShouldRerequestStalledBlock(state, pindexStalling, nNow)) {
+                // The window is held back by a block a slower peer is taking too long to deliver. Ask for it
+                // here instead of waiting for the stalling timeout; the staller's service time estimate absorbs
+                // the time it spent on the block, which shrinks its window.
+                uint32_t nFetchFlags = GetFetchFlags(pto);
+                vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindexStalling->GetBlockHash()));
+                MarkBlockAsInFlight(m_mempool, pto->GetId(), pindexStalling->GetBlockHash(), pindexStalling);
+                LogPrint(BCLog::NET, "Re-requesting straggling block %s (%d) from peer=%d instead of peer=%d\n", pindexStalling->GetBlockHash().ToString(),
+                    pindexStalling->nHeight, pto->GetId(), staller);
+                staller = -1;
+            }
             if (state.nBlocksInFlight == 0 && staller != -1) {
                 if (State(staller)->nStallingSince == 0) {
                     State(staller)->nStallingSince = nNow;
@@ -4564,6 +5172,8 @@ public:
         // orphan transactions
         mapOrphanTransactions.clear();
         mapOrphanTransactionsByPrev.clear();
+        g_orphans_by_peer.clear();
+        g_orphan_bytes = 0;
         mapOrphanBlocks.clear();
         mapOrphanBlocksByPrev.clear();
         setStakeSeenOrphan.clear();
@@ -15,14 +15,17 @@
 
 class CTxMemPool;
 
-extern RecursiveMutex cs_main;
+extern TimedRecursiveMutex cs_main;
 extern RecursiveMutex g_cs_orphans;
 
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/** Default for -maxorphantxsize, maximum total size in kilobytes of orphan transactions kept in memory */
+static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS_SIZE = 5000;
 /** Default number of orphan+recently-replaced txn to keep around for block reconstruction */
 static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
 static const bool DEFAULT_PEERBLOOMFILTERS = false;
+static const bool DEFAULT_PEERBLOCKFILTERS = false;
 /** Default maximum orphan blocks */
 static const unsigned int DEFAULT_MAX_ORPHAN_BLOCKS = 40;
 /** Default for -headerspamfilter, use header spam filter */
@@ -113,6 +116,15 @@ bool ProcessNetBlock(const CChainParams& chainparams, const std::shared_ptr<cons
 
 /** Relay transaction to every node */
 void RelayTransaction(const uint256&, const CConnman& connman);
+/** Relay a batch of transactions to all peers in a single pass over them */
+void RelayTransactions(const std::vector<uint256>& txids, const CConnman& connman);
+
+/** Number of blocks to keep in flight from a peer that takes block_service_time (in microseconds,
+ *  0 if not measured yet) to deliver each block */
+int GetBlocksInTransitLimit(int64_t block_service_time);
+/** Whether a block holding back the download window, requested from a slower peer at time_requested,
+ *  should be re-requested from a peer with the given per-block service time at time now */
+bool ShouldRerequestStalledBlock(int64_t block_service_time, int64_t time_requested, int64_t now);
 
 /** Clean block index */
 void CleanBlockIndex();
@@ -7,25 +7,24 @@
 #include <net.h>
 #include <net_processing.h>
 #include <node/context.h>
+#include <policy/policy.h>
 #include <validation.h>
 #include <validationinterface.h>
 #include <node/transaction.h>
 
+#include <deque>
 #include <future>
+#include <map>
+#include <set>
 
-TransactionError BroadcastTransaction(NodeContext& node, const CTransactionRef tx, std::string& err_string, const CAmount& max_tx_fee, bool relay, bool wait_callback)
+/**
+ * Submit tx to the mempool unless it is already there or confirmed.
+ * Sets submitted if the transaction was newly accepted.
+ */
+static TransactionError SubmitTransaction(NodeContext& node, const CTransactionRef& tx, std::string& err_string, const CAmount& max_tx_fee, bool& submitted) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
-    // BroadcastTransaction can be called by either sendrawtransaction RPC or wallet RPCs.
-    // node.connman is assigned both before chain clients and before RPC server is accepting calls,
-    // and reset after chain clients and RPC sever are stopped. node.connman should never be null here.
-    assert(node.connman);
-    assert(node.mempool);
-    std::promise<void> promise;
-    uint256 hashTx = tx->GetHash();
-    bool callback_set = false;
-
-    { // cs_main scope
-    LOCK(cs_main);
+    submitted = false;
+    const uint256& hashTx = tx->GetHash();
     // If the transaction is already confirmed in the chain, don't do anything
     // and return early.
     CCoinsViewCache &view = ::ChainstateActive().CoinsTip();
@@ -38,7 +37,7 @@ TransactionError BroadcastTransaction(NodeContext& node, const CTransactionRef t
     if (!node.mempool->exists(hashTx)) {
         // Transaction is not already in the mempool. Submit it.
         TxValidationState state;
-        if (!AcceptToMemoryPool(*node.mempool, state, std::move(tx),
+        if (!AcceptToMemoryPool(*node.mempool, state, tx,
                 nullptr /* plTxnReplaced */, false /* bypass_limits */, max_tx_fee)) {
             err_string = state.ToString();
             if (state.IsInvalid()) {
@@ -50,7 +49,28 @@ TransactionError BroadcastTransaction(NodeContext& node, const CTransactionRef t
                 return TransactionError::MEMPOOL_ERROR;
             }
         }
+        submitted = true;
+    }
+    return TransactionError::OK;
+}
+
+TransactionError BroadcastTransaction(NodeContext& node, const CTransactionRef tx, std::string& err_string, const CAmount& max_tx_fee, bool relay, bool wait_callback)
+{
+    // BroadcastTransaction can be called by either sendrawtransaction RPC or wallet RPCs.
+    // node.connman is assigned both before chain clients and before RPC server is accepting calls,
+    // and reset after chain clients and RPC sever are stopped. node.connman should never be null here.
+    assert(node.connman);
+    assert(node.mempool);
+    std::promise<void> promise;
+    uint256 hashTx = tx->GetHash();
+    bool callback_set = false;
 
+    { // cs_main scope
+    LOCK(cs_main);
+    bool submitted;
+    const TransactionError err = SubmitTransaction(node, tx, err_string, max_tx_fee, submitted);
+    if (err != TransactionError::OK) return err;
+    if (submitted) {
         // Transaction was accepted to the mempool.
 
         if (wait_callback) {
@@ -83,3 +103,88 @@ TransactionError BroadcastTransaction(NodeContext& node, const CTransactionRef t
 
     return TransactionError::OK;
 }
+
+/** Order the batch so that in-batch parents come before their children, keeping the given order otherwise */
+static std::vector<size_t> SortParentsFirst(const std::vector<CTransactionRef>& txs)
+{
+    std::map<uint256, size_t> index_by_txid;
+    for (size_t i = 0; i < txs.size(); ++i) {
+        index_by_txid.emplace(txs[i]->GetHash(), i);
+    }
+
+    std::vector<size_t> parent_count(txs.size(), 0);
+    std::vector<std::vector<size_t>> children(txs.size());
+    for (size_t i = 0; i < txs.size(); ++i) {
+        std::set<size_t> parents;
+        for (const CTxIn& txin : txs[i]->vin) {
+            auto it = index_by_txid.find(txin.prevout.hash);
+            if (it != index_by_txid.end() && it->second != i) parents.insert(it->second);
+        }
+        parent_count[i] = parents.size();
+        for (size_t parent : parents) children[parent].push_back(i);
+    }
+
+    std::vector<size_t> order;
+    order.reserve(txs.size());
+    std::deque<size_t> ready;
+    for (size_t i = 0; i < txs.size(); ++i) {
+        if (parent_count[i] == 0) ready.push_back(i);
+    }
+    while (!ready.empty()) {
+        const size_t i = ready.front();
+        ready.pop_front();
+        order.push_back(i);
+        for (size_t child : children[i]) {
+            if (--parent_count[child] == 0) ready.push_back(child);
+        }
+    }
+    // Anything left is part of a dependency cycle and cannot be valid; submit
+    // it anyway so it gets a rejection result.
+    if (order.size() < txs.size()) {
+        for (size_t i = 0; i < txs.size(); ++i) {
+            if (parent_count[i] > 0) order.push_back(i);
+        }
+    }
+    return order;
+}
+
+std::vector<BroadcastResult> BroadcastTransactions(NodeContext& node, const std::vector<CTransactionRef>& txs, const CFeeRate& max_tx_fee_rate, bool relay, bool wait_callback)
+{
+    assert(node.connman);
+    assert(node.mempool);
+    assert(txs.size() <= MAX_BROADCAST_BATCH_SIZE);
+    std::vector<BroadcastResult> results(txs.size());
+    std::vector<uint256> to_relay;
+    std::promise<void> promise;
+    bool callback_set = false;
+
+    { // cs_main scope
+    LOCK(cs_main);
+    bool any_submitted = false;
+    for (size_t i : SortParentsFirst(txs)) {
+        const CAmount max_tx_fee = max_tx_fee_rate.GetFee(GetVirtualTransactionSize(*txs[i]));
+        bool submitted;
+        results[i].err = SubmitTransaction(node, txs[i], results[i].err_string, max_tx_fee, submitted);
+        if (results[i].err == TransactionError::OK) to_relay.push_back(txs[i]->GetHash());
+        any_submitted |= submitted;
+    }
+
+    if (any_submitted && wait_callback) {
+        // See BroadcastTransaction
+        CallFunctionInValidationInterfaceQueue([&promise] {
+            promise.set_value();
+        });
+        callback_set = true;
+    }
+    } // cs_main
+
+    if (callback_set) {
+        promise.get_future().wait();
+    }
+
+    if (relay) {
+        RelayTransactions(to_relay, *node.connman);
+    }
+
+    return results;
+}
@@ -6,9 +6,13 @@
 #define BITCOIN_NODE_TRANSACTION_H
 
 #include <attributes.h>
+#include <policy/feerate.h>
 #include <primitives/transaction.h>
 #include <util/error.h>
 
+#include <string>
+#include <vector>
+
 struct NodeContext;
 
 /**
@@ -30,4 +34,32 @@ struct NodeContext;
  */
 NODISCARD TransactionError BroadcastTransaction(NodeContext& node, CTransactionRef tx, std::string& err_string, const CAmount& max_tx_fee, bool relay, bool wait_callback);
 
+/** Maximum number of transactions in one BroadcastTransactions batch. The whole batch is validated
+ *  under cs_main, so this bounds how long a single call can stall block and peer processing. */
+static const unsigned int MAX_BROADCAST_BATCH_SIZE = 1000;
+
+/** Outcome of submitting one transaction of a batch */
+struct BroadcastResult {
+    TransactionError err = TransactionError::OK;
+    std::string err_string;
+};
+
+/**
+ * Submit a batch of transactions to the mempool under a single cs_main
+ * acquisition and relay the accepted ones to all P2P peers together.
+ *
+ * Transactions are submitted parents first: any transaction spending an
+ * output of another transaction in the batch is submitted after it,
+ * regardless of its position in txs. wait_callback has the same meaning and
+ * the same locking requirements as for BroadcastTransaction.
+ *
+ * @param[in]  node reference to node context
+ * @param[in]  txs the transactions to broadcast, at most MAX_BROADCAST_BATCH_SIZE
+ * @param[in]  max_tx_fee_rate reject txs with a feerate higher than this (if 0, accept any feerate)
+ * @param[in]  relay flag if both mempool insertion and p2p relay are requested
+ * @param[in]  wait_callback wait until callbacks have been processed to avoid stale result due to a sequentially RPC.
+ * return one result per transaction, in the order of txs
+ */
+std::vector<BroadcastResult> BroadcastTransactions(NodeContext& node, const std::vector<CTransactionRef>& txs, const CFeeRate& max_tx_fee_rate, bool relay, bool wait_callback);
+
 #endif // BITCOIN_NODE_TRANSACTION_H
@@ -11,6 +11,8 @@
 #include <util/system.h>
 
 static constexpr double INF_FEERATE = 1e99;
+/** Renormalize the lazily decayed averages once the pending decay drops below this */
+static constexpr double MIN_DECAY_SCALE = 1e-50;
 
 std::string StringForFeeEstimateHorizon(FeeEstimateHorizon horizon) {
     static const std::map<FeeEstimateHorizon, std::string> horizon_strings = {
@@ -40,6 +42,9 @@ private:
     const std::vector<double>& buckets;              // The upper-bound of the range for the bucket (inclusive)
     const std::map<double, unsigned int>& bucketMap; // Map of bucket upper-bound to index into all vectors by bucket
 
+    // Number of buckets, i.e. the row length of the flattened [Y][X] arrays below
+    size_t numBuckets;
+
     // For each bucket X:
     // Count the total # of txs in each bucket
     // Track the historical moving average of this total over blocks
@@ -47,11 +52,11 @@ private:
 
     // Count the total # of txs confirmed within Y blocks in each bucket
     // Track the historical moving average of these totals over blocks
-    std::vector<std::vector<double>> confAvg; // confAvg[Y][X]
+    std::vector<double> confAvg; // confAvg[Y * numBuckets + X]
 
     // Track moving avg of txs which have been evicted from the mempool
     // after failing to be confirmed within Y blocks
-    std::vector<std::vector<double>> failAvg; // failAvg[Y][X]
+    std::vector<double> failAvg; // failAvg[Y * numBuckets + X]
 
     // Sum the total feerate of all tx's in each bucket
     // Track the historical moving average of this total over blocks
@@ -62,18 +67,30 @@ private:
 
     double decay;
 
+    // The moving averages above are stored divided by decayScale, the product
+    // of the per-block decay applied since they were last normalized. Decaying
+    // for a new block then only updates decayScale and new data points are
+    // added as val / decayScale.
+    double decayScale;
+
     // Resolution (# of blocks) with which confirmations are tracked
     unsigned int scale;
 
+    // Number of periods (of scale blocks) for which confirmations are tracked
+    unsigned int maxPeriods;
+
     // Mempool counts of outstanding transactions
     // For each bucket X, track the number of transactions in the mempool
     // that are unconfirmed for each possible confirmation value Y
-    std::vector<std::vector<int> > unconfTxs;  //unconfTxs[Y][X]
+    std::vector<int> unconfTxs;  //unconfTxs[Y * numBuckets + X]
     // transactions still unconfirmed after GetMaxConfirms for each bucket
     std::vector<int> oldUnconfTxs;
 
     void resizeInMemoryCounters(size_t newbuckets);
 
+    /** Fold the pending decay into the stored averages and reset decayScale */
+    void NormalizeAverages();
+
 public:
     /**
      * Create new TxConfirmStats. This is called by BlockPolicyEstimator's
@@ -123,7 +140,7 @@ public:
                              EstimationResult *result = nullptr) const;
 
     /** Return the max number of confirms we're tracking */
-    unsigned int GetMaxConfirms() const { return scale * confAvg.size(); }
+    unsigned int GetMaxConfirms() const { return scale * maxPeriods; }
 
     /** Write state of estimation data to a file*/
     void Write(CAutoFile& fileout) const;
@@ -138,42 +155,37 @@ public:
 
 TxConfirmStats::TxConfirmStats(const std::vector<double>& defaultBuckets,
                                 const std::map<double, unsigned int>& defaultBucketMap,
-                               unsigned int maxPeriods, double _decay, unsigned int _scale)
+                               unsigned int _maxPeriods, double _decay, unsigned int _scale)
     : buckets(defaultBuckets), bucketMap(defaultBucketMap)
 {
     decay = _decay;
+    decayScale = 1;
     assert(_scale != 0 && "_scale must be non-zero");
     scale = _scale;
-    confAvg.resize(maxPeriods);
-    for (unsigned int i = 0; i < maxPeriods; i++) {
-        confAvg[i].resize(buckets.size());
-    }
-    failAvg.resize(maxPeriods);
-    for (unsigned int i = 0; i < maxPeriods; i++) {
-        failAvg[i].resize(buckets.size());
-    }
+    maxPeriods = _maxPeriods;
+    numBuckets = buckets.size();
+    confAvg.resize(maxPeriods * numBuckets);
+    failAvg.resize(maxPeriods * numBuckets);
 
-    txCtAvg.resize(buckets.size());
-    avg.resize(buckets.size());
+    txCtAvg.resize(numBuckets);
+    avg.resize(numBuckets);
 
-    resizeInMemoryCounters(buckets.size());
+    resizeInMemoryCounters(numBuckets);
 }
 
 void TxConfirmStats::resizeInMemoryCounters(size_t newbuckets) {
     // newbuckets must be passed in because the buckets referred to during Read have not been updated yet.
-    unconfTxs.resize(GetMaxConfirms());
-    for (unsigned int i = 0; i < unconfTxs.size(); i++) {
-        unconfTxs[i].resize(newbuckets);
-    }
-    oldUnconfTxs.resize(newbuckets);
+    unconfTxs.assign(GetMaxConfirms() * newbuckets, 0);
+    oldUnconfTxs.assign(newbuckets, 0);
 }
 
 // Roll the unconfirmed txs circular buffer
 void TxConfirmStats::ClearCurrent(unsigned int nBlockHeight)
 {
-    for (unsigned int j = 0; j < buckets.size(); j++) {
-        oldUnconfTxs[j] += unconfTxs[nBlockHeight%unconfTxs.size()][j];
-        unconfTxs[nBlockHeight%unconfTxs.size()][j] = 0;
+    int* current = &unconfTxs[(nBlockHeight % GetMaxConfirms()) * numBuckets];
+    for (size_t j = 0; j < numBuckets; j++) {
+        oldUnconfTxs[j] += current[j];
+        current[j] = 0;
     }
 }
 
@@ -185,25 +197,32 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
         return;
     int periodsToConfirm = (blocksToConfirm + scale - 1)/scale;
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
-    for (size_t i = periodsToConfirm; i <= confAvg.size(); i++) {
-        confAvg[i - 1][bucketindex]++;
+    const double inc = 1 / decayScale;
+    for (size_t i = periodsToConfirm; i <= maxPeriods; i++) {
+        confAvg[(i - 1) * numBuckets + bucketindex] += inc;
     }
-    txCtAvg[bucketindex]++;
-    avg[bucketindex] += val;
+    txCtAvg[bucketindex] += inc;
+    avg[bucketindex] += val * inc;
 }
 
 void TxConfirmStats::UpdateMovingAverages()
 {
-    for (unsigned int j = 0; j < buckets.size(); j++) {
-        for (unsigned int i = 0; i < confAvg.size(); i++)
-            confAvg[i][j] = confAvg[i][j] * decay;
-        for (unsigned int i = 0; i < failAvg.size(); i++)
-            failAvg[i][j] = failAvg[i][j] * decay;
-        avg[j] = avg[j] * decay;
-        txCtAvg[j] = txCtAvg[j] * decay;
+    decayScale *= decay;
+    if (decayScale < MIN_DECAY_SCALE) {
+        NormalizeAverages();
     }
 }
 
+void TxConfirmStats::NormalizeAverages()
+{
+    const double m = decayScale;
+    for (double& v : confAvg) v *= m;
+    for (double& v : failAvg) v *= m;
+    for (double& v : avg) v *= m;
+    for (double& v : txCtAvg) v *= m;
+    decayScale = 1;
+}
+
 // returns -1 on error conditions
 double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
                                          double successBreakPoint, bool requireGreater,
@@ -236,7 +255,7 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     unsigned int bestFarBucket = startbucket;
 
     bool foundAnswer = false;
-    unsigned int bins = unconfTxs.size();
+    unsigned int bins = GetMaxConfirms();
     bool newBucketRange = true;
     bool passing = true;
     EstimatorBucket passBucket;
@@ -249,11 +268,11 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
             newBucketRange = false;
         }
         curFarBucket = bucket;
-        nConf += confAvg[periodTarget - 1][bucket];
-        totalNum += txCtAvg[bucket];
-        failNum += failAvg[periodTarget - 1][bucket];
+        nConf += confAvg[(periodTarget - 1) * numBuckets + bucket] * decayScale;
+        totalNum += txCtAvg[bucket] * decayScale;
+        failNum += failAvg[(periodTarget - 1) * numBuckets + bucket] * decayScale;
         for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
-            extraNum += unconfTxs[(nBlockHeight - confct)%bins][bucket];
+            extraNum += unconfTxs[((nBlockHeight - confct)%bins) * numBuckets + bucket];
         extraNum += oldUnconfTxs[bucket];
         // If we have enough transaction data points in this range of buckets,
         // we can test for success
@@ -306,6 +325,7 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     // Find the bucket with the median transaction and then report the average feerate from that bucket
     // This is a compromise between finding the median which we can't since we don't save all tx's
     // and reporting the average which is less accurate
+    // (txCtAvg and avg are both left in stored units here; decayScale cancels out)
     unsigned int minBucket = std::min(bestNearBucket, bestFarBucket);
     unsigned int maxBucket = std::max(bestNearBucket, bestFarBucket);
     for (unsigned int j = minBucket; j <= maxBucket; j++) {
@@ -359,12 +379,25 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
 
 void TxConfirmStats::Write(CAutoFile& fileout) const
 {
+    // The file keeps the nested [Y][X] layout with the pending decay applied
+    auto decayed = [this](const std::vector<double>& stored) {
+        std::vector<double> out(stored.size());
+        for (size_t i = 0; i < stored.size(); i++) out[i] = stored[i] * decayScale;
+        return out;
+    };
+    auto unflatten = [this](const std::vector<double>& flat) {
+        std::vector<std::vector<double>> out(maxPeriods);
+        for (unsigned int i = 0; i < maxPeriods; i++) {
+            out[i].assign(flat.begin() + i * numBuckets, flat.begin() + (i + 1) * numBuckets);
+        }
+        return out;
+    };
     fileout << decay;
     fileout << scale;
-    fileout << avg;
-    fileout << txCtAvg;
-    fileout << confAvg;
-    fileout << failAvg;
+    fileout << decayed(avg);
+    fileout << decayed(txCtAvg);
+    fileout << unflatten(decayed(confAvg));
+    fileout << unflatten(decayed(failAvg));
 }
 
 void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets)
@@ -372,7 +405,8 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
     // Read data file and do some very basic sanity checking
     // buckets and bucketMap are not updated yet, so don't access them
     // If there is a read failure, we'll just discard this entire object anyway
-    size_t maxConfirms, maxPeriods;
+    size_t maxConfirms;
+    std::vector<std::vector<double>> fileConfAvg, fileFailAvg;
 
     // The current version will store the decay with each individual TxConfirmStats and also keep a scale factor
     filein >> decay;
@@ -392,29 +426,38 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
     if (txCtAvg.size() != numBuckets) {
         throw std::runtime_error("Corrupt estimates file. Mismatch in tx count bucket count");
     }
-    filein >> confAvg;
-    maxPeriods = confAvg.size();
+    filein >> fileConfAvg;
+    maxPeriods = fileConfAvg.size();
     maxConfirms = scale * maxPeriods;
 
     if (maxConfirms <= 0 || maxConfirms > 6 * 24 * 7) { // one week
         throw std::runtime_error("Corrupt estimates file.  Must maintain estimates for between 1 and 1008 (one week) confirms");
     }
     for (unsigned int i = 0; i < maxPeriods; i++) {
-        if (confAvg[i].size() != numBuckets) {
+        if (fileConfAvg[i].size() != numBuckets) {
             throw std::runtime_error("Corrupt estimates file. Mismatch in feerate conf average bucket count");
         }
     }
 
-    filein >> failAvg;
-    if (maxPeriods != failAvg.size()) {
+    filein >> fileFailAvg;
+    if (maxPeriods != fileFailAvg.size()) {
         throw std::runtime_error("Corrupt estimates file. Mismatch in confirms tracked for failures");
     }
     for (unsigned int i = 0; i < maxPeriods; i++) {
-        if (failAvg[i].size() != numBuckets) {
+        if (fileFailAvg[i].size() != numBuckets) {
             throw std::runtime_error("Corrupt estimates file. Mismatch in one of failure average bucket counts");
         }
     }
 
+    this->numBuckets = numBuckets;
+    decayScale = 1;
+    confAvg.clear();
+    failAvg.clear();
+    for (unsigned int i = 0; i < maxPeriods; i++) {
+        confAvg.insert(confAvg.end(), fileConfAvg[i].begin(), fileConfAvg[i].end());
+        failAvg.insert(failAvg.end(), fileFailAvg[i].begin(), fileFailAvg[i].end());
+    }
+
     // Resize the current block variables which aren't stored in the data file
     // to match the number of confirms and buckets
     resizeInMemoryCounters(numBuckets);
@@ -426,8 +469,8 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
 unsigned int TxConfirmStats::NewTx(unsigned int nBlockHeight, double val)
 {
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
-    unsigned int blockIndex = nBlockHeight % unconfTxs.size();
-    unconfTxs[blockIndex][bucketindex]++;
+    unsigned int blockIndex = nBlockHeight % GetMaxConfirms();
+    unconfTxs[blockIndex * numBuckets + bucketindex]++;
     return bucketindex;
 }
 
@@ -442,7 +485,7 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
         return;  //This can't happen because we call this with our best seen height, no entries can have higher
     }
 
-    if (blocksAgo >= (int)unconfTxs.size()) {
+    if (blocksAgo >= (int)GetMaxConfirms()) {
         if (oldUnconfTxs[bucketindex] > 0) {
             oldUnconfTxs[bucketindex]--;
         } else {
@@ -451,9 +494,9 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
         }
     }
     else {
-        unsigned int blockIndex = entryHeight % unconfTxs.size();
-        if (unconfTxs[blockIndex][bucketindex] > 0) {
-            unconfTxs[blockIndex][bucketindex]--;
+        unsigned int blockIndex = entryHeight % GetMaxConfirms();
+        if (unconfTxs[blockIndex * numBuckets + bucketindex] > 0) {
+            unconfTxs[blockIndex * numBuckets + bucketindex]--;
         } else {
             LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy error, mempool tx removed from blockIndex=%u,bucketIndex=%u already\n",
                      blockIndex, bucketindex);
@@ -462,8 +505,9 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
     if (!inBlock && (unsigned int)blocksAgo >= scale) { // Only counts as a failure if not confirmed for entire period
         assert(scale != 0);
         unsigned int periodsAgo = blocksAgo / scale;
-        for (size_t i = 0; i < periodsAgo && i < failAvg.size(); i++) {
-            failAvg[i][bucketindex]++;
+        const double inc = 1 / decayScale;
+        for (size_t i = 0; i < periodsAgo && i < maxPeriods; i++) {
+            failAvg[i * numBuckets + bucketindex] += inc;
         }
     }
 }
@@ -593,6 +637,7 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
     // calls to removeTx (via processBlockTx) correctly calculate age
     // of unconfirmed txs to remove from tracking.
     nBestSeenHeight = nBlockHeight;
+    ClearSmartFeeCache();
 
     // Update unconfirmed circular buffer
     feeStats->ClearCurrent(nBlockHeight);
@@ -784,8 +829,35 @@ double CBlockPolicyEstimator::estimateConservativeFee(unsigned int doubleTarget,
  */
 CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const
 {
+    const std::pair<int, bool> key(confTarget, conservative);
+    {
+        LOCK(m_cs_smart_fee_cache);
+        auto it = m_smart_fee_cache.find(key);
+        if (it != m_smart_fee_cache.end()) {
+            if (feeCalc) *feeCalc = it->second.second;
+            return it->second.first;
+        }
+    }
+
     LOCK(m_cs_fee_estimator);
+    FeeCalculation calc;
+    CFeeRate result = estimateSmartFeeUncached(confTarget, &calc, conservative);
+    {
+        LOCK(m_cs_smart_fee_cache);
+        m_smart_fee_cache.emplace(key, std::make_pair(result, calc));
+    }
+    if (feeCalc) *feeCalc = calc;
+    return result;
+}
 
+void CBlockPolicyEstimator::ClearSmartFeeCache() const
+{
+    LOCK(m_cs_smart_fee_cache);
+    m_smart_fee_cache.clear();
+}
+
+CFeeRate CBlockPolicyEstimator::estimateSmartFeeUncached(int confTarget, FeeCalculation *feeCalc, bool conservative) const
+{
     if (feeCalc) {
         feeCalc->desiredTarget = confTarget;
         feeCalc->returnedTarget = confTarget;
@@ -937,6 +1009,7 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
             nBestSeenHeight = nFileBestSeenHeight;
             historicalFirst = nFileHistoricalFirst;
             historicalBest = nFileHistoricalBest;
+            ClearSmartFeeCache();
         }
     }
     catch (const std::exception& e) {
@@ -955,6 +1028,7 @@ void CBlockPolicyEstimator::FlushUnconfirmed() {
         auto mi = mapMemPoolTxs.begin();
         removeTx(mi->first, false); // this calls erase() on mapMemPoolTxs
     }
+    ClearSmartFeeCache();
     int64_t endclear = GetTimeMicros();
     LogPrint(BCLog::ESTIMATEFEE, "Recorded %u unconfirmed txs from mempool in %gs\n", num_entries, (endclear - startclear)*0.000001);
 }
@@ -970,6 +1044,7 @@ FeeFilterRounder::FeeFilterRounder(const CFeeRate& minIncrementalFee)
 
 CAmount FeeFilterRounder::round(CAmount currentMinFee)
 {
+    LOCK(m_insecure_rand_mutex);
     std::set<double>::iterator it = feeset.lower_bound(currentMinFee);
     if ((it != feeset.begin() && insecure_rand.rand32() % 3 != 0) || it == feeset.end()) {
         it--;
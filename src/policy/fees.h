@@ -14,6 +14,7 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 class CAutoFile;
@@ -201,6 +202,9 @@ public:
      *  blocks. If no answer can be given at confTarget, return an estimate at
      *  the closest target where one can be given.  'conservative' estimates are
      *  valid over longer time horizons also.
+     *  Answers are cached per (confTarget, conservative) until the next block
+     *  is processed and are served from the cache without taking the estimator
+     *  lock.
      */
     CFeeRate estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const;
 
@@ -251,6 +255,17 @@ private:
     std::vector<double> buckets GUARDED_BY(m_cs_fee_estimator); // The upper-bound of the range for the bucket (inclusive)
     std::map<double, unsigned int> bucketMap GUARDED_BY(m_cs_fee_estimator); // Map of bucket upper-bound to index into all vectors by bucket
 
+    /** estimateSmartFee answers for the current best seen height, keyed by
+     *  (confTarget, conservative). Filled under m_cs_fee_estimator and cleared
+     *  whenever the underlying stats move to a new block. */
+    mutable Mutex m_cs_smart_fee_cache;
+    mutable std::map<std::pair<int, bool>, std::pair<CFeeRate, FeeCalculation>> m_smart_fee_cache GUARDED_BY(m_cs_smart_fee_cache);
+
+    /** Drop all cached estimateSmartFee answers */
+    void ClearSmartFeeCache() const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+    /** estimateSmartFee without the cache */
+    CFeeRate estimateSmartFeeUncached(int confTarget, FeeCalculation *feeCalc, bool conservative) const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+
     /** Process a transaction confirmed in a block*/
     bool processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry) EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
 
@@ -285,7 +300,8 @@ public:
 
 private:
     std::set<double> feeset;
-    FastRandomContext insecure_rand;
+    Mutex m_insecure_rand_mutex;
+    FastRandomContext insecure_rand GUARDED_BY(m_insecure_rand_mutex);
 };
 
 #endif // BITCOIN_POLICY_FEES_H
@@ -304,9 +304,13 @@ private:
     /** Memory only. */
     const uint256 hash;
     const uint256 m_witness_hash;
+    const unsigned int m_total_size;
+    const unsigned int m_stripped_size;
 
     uint256 ComputeHash() const;
     uint256 ComputeWitnessHash() const;
+    unsigned int ComputeTotalSize() const;
+    unsigned int ComputeStrippedSize() const;
 
 public:
     /** Construct a CTransaction that qualifies as IsNull() */
@@ -343,7 +347,13 @@ public:
      * "Total Size" defined in BIP141 and BIP144.
      * @return Total transaction size in bytes
      */
-    unsigned int GetTotalSize() const;
+    unsigned int GetTotalSize() const { return m_total_size; }
+
+    /**
+     * Get the transaction size in bytes, excluding witness data.
+     * "Base transaction size" defined in BIP141.
+     */
+    unsigned int GetStrippedSize() const { return m_stripped_size; }
 
     bool IsCoinBase() const
     {
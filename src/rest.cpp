@@ -9,6 +9,7 @@
 #include <httpserver.h>
 #include <index/txindex.h>
 #include <node/context.h>
+#include <policy/fees.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <rpc/blockchain.h>
@@ -358,6 +359,114 @@ static bool rest_mempool_contents(HTTPRequest* req, const std::string& strURIPar
     }
 }
 
+static bool rest_mempool_snapshot(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req)) return false;
+    const CTxMemPool* mempool = GetMemPool(req);
+    if (!mempool) return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+
+    switch (rf) {
+    case RetFormat::JSON: {
+        UniValue txids(UniValue::VARR);
+        uint64_t sequence;
+        {
+            LOCK(mempool->cs);
+            for (const CTxMemPoolEntry& e : mempool->mapTx) {
+                txids.push_back(e.GetTx().GetHash().ToString());
+            }
+            sequence = mempool->GetSequence();
+        }
+        UniValue snapshotObject(UniValue::VOBJ);
+        snapshotObject.pushKV("sequence", sequence);
+        snapshotObject.pushKV("txids", txids);
+
+        std::string strJSON = snapshotObject.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+}
+
+// One entry per distinct confirmation target the estimator can answer for,
+// from the fastest target up to the highest one currently usable.
+static UniValue FeeCurveToJSON(bool conservative)
+{
+    UniValue curve(UniValue::VARR);
+    const unsigned int max_target = ::feeEstimator.HighestTargetTracked(FeeEstimateHorizon::LONG_HALFLIFE);
+    int last_target = 0;
+    for (unsigned int target = 1; target <= max_target; ++target) {
+        FeeCalculation fee_calc;
+        const CFeeRate feerate = ::feeEstimator.estimateSmartFee(target, &fee_calc, conservative);
+        if (feerate != CFeeRate(0) && fee_calc.returnedTarget > last_target) {
+            UniValue entry(UniValue::VOBJ);
+            entry.pushKV("blocks", fee_calc.returnedTarget);
+            entry.pushKV("feerate", ValueFromAmount(feerate.GetFeePerK()));
+            curve.push_back(entry);
+            last_target = fee_calc.returnedTarget;
+        }
+        // Every higher target is clamped to the same answer
+        if (fee_calc.returnedTarget < (int)target) break;
+    }
+    return curve;
+}
+
+static bool rest_fee_estimates(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req)) return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+
+    switch (rf) {
+    case RetFormat::JSON: {
+        UniValue feeObject(UniValue::VOBJ);
+        feeObject.pushKV("economical", FeeCurveToJSON(false));
+        feeObject.pushKV("conservative", FeeCurveToJSON(true));
+
+        std::string strJSON = feeObject.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+}
+
+// A bit of a hack - dependency on a function defined in rpc/net.cpp
+UniValue getnettotals(const JSONRPCRequest& request);
+
+static bool rest_net_stats(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req)) return false;
+    if (!g_rpc_node || !g_rpc_node->connman) {
+        return RESTERR(req, HTTP_NOT_FOUND, "Peer-to-peer functionality missing or disabled");
+    }
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+
+    switch (rf) {
+    case RetFormat::JSON: {
+        JSONRPCRequest jsonRequest;
+        jsonRequest.params = UniValue(UniValue::VARR);
+        UniValue netTotalsObject = getnettotals(jsonRequest);
+        std::string strJSON = netTotalsObject.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+}
+
 static bool rest_tx(HTTPRequest* req, const std::string& strURIPart)
 {
     if (!CheckWarmup(req))
@@ -656,6 +765,9 @@ static const struct {
       {"/rest/chaininfo", rest_chaininfo},
       {"/rest/mempool/info", rest_mempool_info},
       {"/rest/mempool/contents", rest_mempool_contents},
+      {"/rest/mempool/snapshot", rest_mempool_snapshot},
+      {"/rest/feeestimates", rest_fee_estimates},
+      {"/rest/netstats", rest_net_stats},
       {"/rest/headers/", rest_headers},
       {"/rest/getutxos", rest_getutxos},
       {"/rest/blockhashbyheight/", rest_blockhash_by_height},
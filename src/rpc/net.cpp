@@ -72,6 +72,54 @@ static UniValue ping(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+static std::vector<RPCResult> MsgProcessingStatsDoc()
+{
+    const std::string hist_doc{"Message count per power-of-two bucket: entry i counts durations below 2^i microseconds and at least 2^(i-1), the last entry all longer ones. Trailing empty buckets are omitted"};
+    return {
+        {RPCResult::Type::OBJ, "msg", "",
+        {
+            {RPCResult::Type::NUM, "count", "Number of messages processed"},
+            {RPCResult::Type::NUM, "queuewait_us", "Total time (in microseconds) messages waited between receipt and processing"},
+            {RPCResult::Type::NUM, "process_us", "Total time (in microseconds) spent processing messages"},
+            {RPCResult::Type::NUM, "cs_main_us", "Total time (in microseconds) cs_main was held while processing messages"},
+            {RPCResult::Type::ARR, "queuewait_hist", "Distribution of queue wait time. " + hist_doc, {{RPCResult::Type::NUM, "", ""}}},
+            {RPCResult::Type::ARR, "process_hist", "Distribution of processing time. " + hist_doc, {{RPCResult::Type::NUM, "", ""}}},
+            {RPCResult::Type::ARR, "cs_main_hist", "Distribution of cs_main hold time. " + hist_doc, {{RPCResult::Type::NUM, "", ""}}},
+        }},
+    };
+}
+
+static UniValue MsgTimeHistogramToJSON(const MsgTimeHistogram& hist)
+{
+    size_t used = hist.buckets.size();
+    while (used > 0 && hist.buckets[used - 1] == 0) {
+        --used;
+    }
+    UniValue ret(UniValue::VARR);
+    for (size_t i = 0; i < used; ++i) {
+        ret.push_back(hist.buckets[i]);
+    }
+    return ret;
+}
+
+static UniValue MsgProcessingStatsToJSON(const mapMsgCmdProcessingStats& stats_per_msg)
+{
+    UniValue ret(UniValue::VOBJ);
+    for (const auto& i : stats_per_msg) {
+        const MsgProcessingStats& stats = i.second;
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("count", stats.process.count);
+        obj.pushKV("queuewait_us", stats.queue_wait.total_usec);
+        obj.pushKV("process_us", stats.process.total_usec);
+        obj.pushKV("cs_main_us", stats.cs_main.total_usec);
+        obj.pushKV("queuewait_hist", MsgTimeHistogramToJSON(stats.queue_wait));
+        obj.pushKV("process_hist", MsgTimeHistogramToJSON(stats.process));
+        obj.pushKV("cs_main_hist", MsgTimeHistogramToJSON(stats.cs_main));
+        ret.pushKV(i.first, obj);
+    }
+    return ret;
+}
+
 static UniValue getpeerinfo(const JSONRPCRequest& request)
 {
             RPCHelpMan{"getpeerinfo",
@@ -130,6 +178,8 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
                                                               "When a message type is not listed in this json object, the bytes received are 0.\n"
                                                               "Only known message types can appear as keys in the object and all bytes received of unknown message types are listed under '"+NET_MESSAGE_COMMAND_OTHER+"'."}
                             }},
+                            {RPCResult::Type::OBJ_DYN, "processing_per_msg", "The cost of processing this peer's messages, aggregated by message type like bytesrecv_per_msg",
+                                MsgProcessingStatsDoc()},
                         }},
                     }},
                 },
@@ -217,6 +267,7 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
                 recvPerMsgCmd.pushKV(i.first, i.second);
         }
         obj.pushKV("bytesrecv_per_msg", recvPerMsgCmd);
+        obj.pushKV("processing_per_msg", MsgProcessingStatsToJSON(stats.mapProcessingStatsPerMsgCmd));
 
         ret.push_back(obj);
     }
@@ -389,7 +440,7 @@ static UniValue getaddednodeinfo(const JSONRPCRequest& request)
     return ret;
 }
 
-static UniValue getnettotals(const JSONRPCRequest& request)
+UniValue getnettotals(const JSONRPCRequest& request)
 {
             RPCHelpMan{"getnettotals",
                 "\nReturns information about network traffic, including bytes in, bytes out,\n"
@@ -401,6 +452,8 @@ static UniValue getnettotals(const JSONRPCRequest& request)
                        {RPCResult::Type::NUM, "totalbytesrecv", "Total bytes received"},
                        {RPCResult::Type::NUM, "totalbytessent", "Total bytes sent"},
                        {RPCResult::Type::NUM_TIME, "timemillis", "Current UNIX time in milliseconds"},
+                       {RPCResult::Type::OBJ_DYN, "processing_per_msg", "The cost of processing messages from all peers, including disconnected ones, aggregated by message type",
+                           MsgProcessingStatsDoc()},
                        {RPCResult::Type::OBJ, "uploadtarget", "",
                        {
                            {RPCResult::Type::NUM, "timeframe", "Length of the measuring timeframe in seconds"},
@@ -424,6 +477,7 @@ static UniValue getnettotals(const JSONRPCRequest& request)
     obj.pushKV("totalbytesrecv", g_rpc_node->connman->GetTotalBytesRecv());
     obj.pushKV("totalbytessent", g_rpc_node->connman->GetTotalBytesSent());
     obj.pushKV("timemillis", GetTimeMillis());
+    obj.pushKV("processing_per_msg", MsgProcessingStatsToJSON(g_rpc_node->connman->GetMessageProcessingStats()));
 
     UniValue outboundLimit(UniValue::VOBJ);
     outboundLimit.pushKV("timeframe", g_rpc_node->connman->GetMaxOutboundTimeframe());
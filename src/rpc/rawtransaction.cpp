@@ -855,6 +855,84 @@ static UniValue sendrawtransaction(const JSONRPCRequest& request)
     return tx->GetHash().GetHex();
 }
 
+static UniValue sendrawtransactions(const JSONRPCRequest& request)
+{
+    RPCHelpMan{"sendrawtransactions",
+                "\nSubmit a batch of at most " + ToString(MAX_BROADCAST_BATCH_SIZE) + " raw transactions (serialized, hex-encoded) to local node and network.\n"
+                "\nAll transactions are validated under a single lock acquisition. Transactions spending\n"
+                "outputs of other transactions in the batch are submitted after them, in whatever order\n"
+                "they are given. Accepted transactions are relayed together.\n"
+                "\nSee sendrawtransaction call.\n",
+                {
+                    {"rawtxs", RPCArg::Type::ARR, RPCArg::Optional::NO, "An array of hex strings of raw transactions.",
+                        {
+                            {"rawtx", RPCArg::Type::STR_HEX, RPCArg::Optional::OMITTED, ""},
+                        },
+                        },
+                    {"maxfeerate", RPCArg::Type::AMOUNT, /* default */ FormatMoney(DEFAULT_MAX_RAW_TX_FEE_RATE.GetFeePerK()),
+                        "Reject transactions whose fee rate is higher than the specified value, expressed in " + CURRENCY_UNIT +
+                            "/kB.\nSet to 0 to accept any fee rate.\n"},
+                },
+                RPCResult{
+                    RPCResult::Type::ARR, "", "The submission result for each raw transaction in the input array, in the same order.",
+                    {
+                        {RPCResult::Type::OBJ, "", "",
+                        {
+                            {RPCResult::Type::STR_HEX, "txid", "The transaction hash in hex"},
+                            {RPCResult::Type::BOOL, "accepted", "If the transaction is in the mempool or already confirmed"},
+                            {RPCResult::Type::STR, "error", "Rejection string (only present when 'accepted' is false)"},
+                        }},
+                    }
+                },
+                RPCExamples{
+            "\nSend a parent and its child (signed hex)\n"
+            + HelpExampleCli("sendrawtransactions", R"('["signedparenthex", "signedchildhex"]')") +
+            "\nAs a JSON-RPC call\n"
+            + HelpExampleRpc("sendrawtransactions", "[\"signedparenthex\", \"signedchildhex\"]")
+                },
+    }.Check(request);
+
+    RPCTypeCheck(request.params, {
+        UniValue::VARR,
+        UniValueType(), // NUM, checked later
+    });
+
+    const UniValue& rawtxs = request.params[0].get_array();
+    if (rawtxs.size() > MAX_BROADCAST_BATCH_SIZE) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Too many transactions: %u, the maximum is %u", rawtxs.size(), MAX_BROADCAST_BATCH_SIZE));
+    }
+    std::vector<CTransactionRef> txs;
+    txs.reserve(rawtxs.size());
+    for (size_t i = 0; i < rawtxs.size(); ++i) {
+        CMutableTransaction mtx;
+        if (!DecodeHexTx(mtx, rawtxs[i].get_str())) {
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("TX decode failed for transaction %u", i));
+        }
+        txs.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+
+    CFeeRate max_raw_tx_fee_rate = DEFAULT_MAX_RAW_TX_FEE_RATE;
+    if (!request.params[1].isNull()) {
+        max_raw_tx_fee_rate = CFeeRate(AmountFromValue(request.params[1]));
+    }
+
+    AssertLockNotHeld(cs_main);
+    const std::vector<BroadcastResult> results = BroadcastTransactions(*g_rpc_node, txs, max_raw_tx_fee_rate, /*relay*/ true, /*wait_callback*/ true);
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < txs.size(); ++i) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("txid", txs[i]->GetHash().GetHex());
+        const bool accepted = results[i].err == TransactionError::OK || results[i].err == TransactionError::ALREADY_IN_CHAIN;
+        entry.pushKV("accepted", accepted);
+        if (!accepted) {
+            entry.pushKV("error", results[i].err_string.empty() ? TransactionErrorString(results[i].err) : results[i].err_string);
+        }
+        result.push_back(std::move(entry));
+    }
+    return result;
+}
+
 static UniValue testmempoolaccept(const JSONRPCRequest& request)
 {
     RPCHelpMan{"testmempoolaccept",
@@ -1824,6 +1902,7 @@ static const CRPCCommand commands[] =
     { "rawtransactions",    "decoderawtransaction",         &decoderawtransaction,      {"hexstring","iswitness"} },
     { "rawtransactions",    "decodescript",                 &decodescript,              {"hexstring"} },
     { "rawtransactions",    "sendrawtransaction",           &sendrawtransaction,        {"hexstring","allowhighfees|maxfeerate"} },
+    { "rawtransactions",    "sendrawtransactions",          &sendrawtransactions,       {"rawtxs","maxfeerate"} },
     { "rawtransactions",    "combinerawtransaction",        &combinerawtransaction,     {"txs"} },
     { "rawtransactions",    "signrawtransactionwithkey",    &signrawtransactionwithkey, {"hexstring","privkeys","prevtxs","sighashtype"} },
     { "rawtransactions",    "testmempoolaccept",            &testmempoolaccept,         {"rawtxs","allowhighfees|maxfeerate"} },
@@ -53,4 +53,13 @@ public:
 
 void InitSignatureCache();
 
+/** Copy out the signature cache nonce and all entries still live in the cache. */
+void GetSignatureCacheState(uint256& nonce, std::vector<uint256>& entries);
+/**
+ * Replace the signature cache nonce and insert entries previously obtained
+ * with GetSignatureCacheState. Entries computed under the old nonce become
+ * unreachable, so this should be called before the cache is used.
+ */
+void SetSignatureCacheState(const uint256& nonce, const std::vector<uint256>& entries);
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
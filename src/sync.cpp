@@ -28,6 +28,26 @@ void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+#if defined(HAVE_THREAD_LOCAL)
+static thread_local int64_t g_thread_lock_held_time{0};
+#endif
+
+int64_t TimedRecursiveMutex::GetThreadHeldTime()
+{
+#if defined(HAVE_THREAD_LOCAL)
+    return g_thread_lock_held_time / 1000;
+#else
+    return 0;
+#endif
+}
+
+void TimedRecursiveMutex::AddThreadHeldTime(int64_t nsec)
+{
+#if defined(HAVE_THREAD_LOCAL)
+    g_thread_lock_held_time += nsec;
+#endif
+}
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
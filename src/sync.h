@@ -9,6 +9,7 @@
 #include <threadsafety.h>
 #include <util/macros.h>
 
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
 #include <string>
@@ -112,6 +113,49 @@ using RecursiveMutex = AnnotatedMixin<std::recursive_mutex>;
 /** Wrapped mutex: supports waiting but not recursive locking */
 typedef AnnotatedMixin<std::mutex> Mutex;
 
+/**
+ * RecursiveMutex that accounts how long each thread holds it, from the
+ * outermost acquisition to the matching release. Used for cs_main, so that
+ * callers can attribute lock hold time to the work they did.
+ */
+class LOCKABLE TimedRecursiveMutex : public RecursiveMutex
+{
+public:
+    void lock() EXCLUSIVE_LOCK_FUNCTION()
+    {
+        RecursiveMutex::lock();
+        if (m_lock_depth++ == 0) m_locked_since = std::chrono::steady_clock::now();
+    }
+
+    void unlock() UNLOCK_FUNCTION()
+    {
+        if (--m_lock_depth == 0) {
+            AddThreadHeldTime(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_locked_since).count());
+        }
+        RecursiveMutex::unlock();
+    }
+
+    bool try_lock() EXCLUSIVE_TRYLOCK_FUNCTION(true)
+    {
+        if (!RecursiveMutex::try_lock()) return false;
+        if (m_lock_depth++ == 0) m_locked_since = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    using UniqueLock = std::unique_lock<TimedRecursiveMutex>;
+
+    /** Total time (in microseconds) the calling thread has held any TimedRecursiveMutex. Always 0 without thread_local support. */
+    static int64_t GetThreadHeldTime();
+
+private:
+    //! Accumulated in nanoseconds, as most holds are shorter than a microsecond.
+    static void AddThreadHeldTime(int64_t nsec);
+
+    //! Only accessed by the thread holding the mutex.
+    int m_lock_depth{0};
+    std::chrono::steady_clock::time_point m_locked_since;
+};
+
 #ifdef DEBUG_LOCKCONTENTION
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
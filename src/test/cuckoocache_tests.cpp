@@ -363,4 +363,36 @@ BOOST_AUTO_TEST_CASE(cuckoocache_generations)
     test_cache_generations<CuckooCache::cache<uint256, SignatureCacheHasher>>();
 }
 
+/* Test that for_each_live visits exactly the entries which have not been
+ * erased, and that re-inserting them into a fresh cache (as is done when the
+ * cache is loaded from disk) preserves them.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_for_each_live)
+{
+    SeedInsecureRand(SeedRand::ZEROS);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+    cc.setup_bytes(1 << 20);
+    std::vector<uint256> hashes(1000);
+    for (uint256& h : hashes) {
+        h = InsecureRand256();
+        cc.insert(h);
+    }
+    for (size_t i = 0; i < hashes.size(); i += 2) {
+        BOOST_CHECK(cc.contains(hashes[i], true));
+    }
+
+    std::vector<uint256> live;
+    cc.for_each_live([&live](const uint256& h) { live.push_back(h); });
+    BOOST_CHECK_EQUAL(live.size(), hashes.size() / 2);
+
+    CuckooCache::cache<uint256, SignatureCacheHasher> reloaded{};
+    reloaded.setup_bytes(1 << 20);
+    for (const uint256& h : live) {
+        reloaded.insert(h);
+    }
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        BOOST_CHECK_EQUAL(reloaded.contains(hashes[i], false), i % 2 == 1);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END();
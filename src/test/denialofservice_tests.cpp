@@ -20,6 +20,7 @@
 
 #include <test/util/setup_common.h>
 
+#include <algorithm>
 #include <stdint.h>
 
 #include <boost/test/unit_test.hpp>
@@ -44,13 +45,15 @@ struct CConnmanTest : public CConnman {
 // Tests these internal-to-net_processing.cpp methods:
 extern bool AddOrphanTx(const CTransactionRef& tx, NodeId peer);
 extern void EraseOrphansFor(NodeId peer);
-extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
+extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans, size_t nMaxOrphanBytes);
 extern void Misbehaving(NodeId nodeid, int howmuch, const std::string& message="");
 
 struct COrphanTx {
     CTransactionRef tx;
     NodeId fromPeer;
     int64_t nTimeExpire;
+    size_t list_pos;
+    size_t nTxSize;
 };
 extern std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(g_cs_orphans);
 
@@ -439,12 +442,92 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
     }
 
     // Test LimitOrphanTxSize() function:
-    LimitOrphanTxSize(40);
+    const size_t no_byte_limit = std::numeric_limits<size_t>::max();
+    LimitOrphanTxSize(40, no_byte_limit);
     BOOST_CHECK(mapOrphanTransactions.size() <= 40);
-    LimitOrphanTxSize(10);
+    LimitOrphanTxSize(10, no_byte_limit);
     BOOST_CHECK(mapOrphanTransactions.size() <= 10);
-    LimitOrphanTxSize(0);
+
+    // ... and its byte limit:
+    size_t orphan_bytes = 0;
+    for (const auto& orphan : mapOrphanTransactions) {
+        orphan_bytes += orphan.second.tx->GetTotalSize();
+    }
+    LimitOrphanTxSize(10, orphan_bytes / 2);
+    size_t orphan_bytes_after = 0;
+    for (const auto& orphan : mapOrphanTransactions) {
+        orphan_bytes_after += orphan.second.tx->GetTotalSize();
+    }
+    BOOST_CHECK(orphan_bytes_after <= orphan_bytes / 2);
+    BOOST_CHECK(!mapOrphanTransactions.empty());
+
+    LimitOrphanTxSize(0, no_byte_limit);
+    BOOST_CHECK(mapOrphanTransactions.empty());
+
+    // The byte limit evicts from the peer holding the most orphan bytes: peer
+    // 1 has ten small orphans, peer 2 three big ones, more bytes in total.
+    const auto make_orphan = [](size_t num_inputs) {
+        CMutableTransaction tx;
+        tx.vin.resize(num_inputs);
+        for (CTxIn& txin : tx.vin) {
+            txin.prevout = COutPoint(InsecureRand256(), 0);
+        }
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1*CENT;
+        return MakeTransactionRef(tx);
+    };
+    for (int i = 0; i < 10; i++) {
+        BOOST_CHECK(AddOrphanTx(make_orphan(1), 1));
+    }
+    for (int i = 0; i < 3; i++) {
+        BOOST_CHECK(AddOrphanTx(make_orphan(30), 2));
+    }
+    const auto orphans_from = [](NodeId peer) {
+        return std::count_if(mapOrphanTransactions.begin(), mapOrphanTransactions.end(),
+            [peer](const std::pair<const uint256, COrphanTx>& orphan) { return orphan.second.fromPeer == peer; });
+    };
+    orphan_bytes = 0;
+    for (const auto& orphan : mapOrphanTransactions) {
+        orphan_bytes += orphan.second.tx->GetTotalSize();
+    }
+    BOOST_CHECK_EQUAL(LimitOrphanTxSize(100, orphan_bytes - 1), 1U);
+    BOOST_CHECK_EQUAL(orphans_from(1), 10);
+    BOOST_CHECK_EQUAL(orphans_from(2), 2);
+    EraseOrphansFor(1);
+    EraseOrphansFor(2);
+    BOOST_CHECK(mapOrphanTransactions.empty());
+
+    // Resolving orphans yields to other peers after MAX_ORPHAN_TX_RESOLVE_BATCH
+    // (8) of them were accepted or rejected. Non-standard orphans are rejected
+    // without punishing the peer that sent them.
+    auto connman = MakeUnique<CConnmanTest>(0x1337, 0x1337);
+    auto peerLogic = MakeUnique<PeerLogicValidation>(connman.get(), nullptr, *m_node.scheduler, *m_node.mempool);
+    CAddress addr(ip(0xa0b0c001), NODE_NONE);
+    CNode dummyNode(id++, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", /*fInboundIn=*/ true);
+    dummyNode.SetSendVersion(PROTOCOL_VERSION);
+    peerLogic->InitializeNode(&dummyNode);
+    dummyNode.nVersion = 1;
+    dummyNode.fSuccessfullyConnected = true;
+    for (int i = 0; i < 20; i++) {
+        CMutableTransaction tx(*make_orphan(1));
+        tx.nVersion = 3;
+        const CTransactionRef orphan = MakeTransactionRef(tx);
+        BOOST_CHECK(AddOrphanTx(orphan, dummyNode.GetId()));
+        dummyNode.orphan_work_set.insert(orphan->GetHash());
+    }
+    std::atomic<bool> interrupt{false};
+    BOOST_CHECK(peerLogic->ProcessMessages(&dummyNode, interrupt));
+    BOOST_CHECK_EQUAL(dummyNode.orphan_work_set.size(), 12U);
+    BOOST_CHECK_EQUAL(mapOrphanTransactions.size(), 12U);
+    BOOST_CHECK(peerLogic->ProcessMessages(&dummyNode, interrupt));
+    BOOST_CHECK_EQUAL(dummyNode.orphan_work_set.size(), 4U);
+    BOOST_CHECK(!peerLogic->ProcessMessages(&dummyNode, interrupt));
+    BOOST_CHECK(dummyNode.orphan_work_set.empty());
     BOOST_CHECK(mapOrphanTransactions.empty());
+    BOOST_CHECK(!dummyNode.fDisconnect);
+
+    bool dummy;
+    peerLogic->FinalizeNode(dummyNode.GetId(), dummy);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
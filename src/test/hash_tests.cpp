@@ -145,6 +145,26 @@ BOOST_AUTO_TEST_CASE(siphash)
         BOOST_CHECK_EQUAL(SipHashUint256(k1, k2, x), sip256.Finalize());
         BOOST_CHECK_EQUAL(SipHashUint256Extra(k1, k2, x, n), sip288.Finalize());
     }
+
+    // Check consistency between SipHashUint256 and PresaltedSipHasher, both
+    // one value at a time and four at once.
+    for (int i = 0; i < 16; ++i) {
+        uint64_t k1 = ctx.rand64();
+        uint64_t k2 = ctx.rand64();
+        const PresaltedSipHasher hasher(k1, k2);
+        uint256 xs[4];
+        const uint256* ptrs[4];
+        for (int l = 0; l < 4; ++l) {
+            xs[l] = InsecureRand256();
+            ptrs[l] = &xs[l];
+        }
+        uint64_t out[4];
+        hasher.Hash4(ptrs, out);
+        for (int l = 0; l < 4; ++l) {
+            BOOST_CHECK_EQUAL(hasher(xs[l]), SipHashUint256(k1, k2, xs[l]));
+            BOOST_CHECK_EQUAL(out[l], SipHashUint256(k1, k2, xs[l]));
+        }
+    }
 }
 
 BOOST_AUTO_TEST_SUITE_END()
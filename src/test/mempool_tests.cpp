@@ -2,10 +2,14 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <consensus/validation.h>
 #include <policy/policy.h>
+#include <script/standard.h>
+#include <streams.h>
 #include <txmempool.h>
 #include <util/system.h>
 #include <util/time.h>
+#include <validation.h>
 
 #include <test/util/setup_common.h>
 
@@ -592,6 +596,56 @@ inline CTransactionRef make_tx(std::vector<CAmount>&& output_values, std::vector
 }
 
 
+BOOST_AUTO_TEST_CASE(MempoolLowWaterTrimTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+    entry.Time(GetTime());
+
+    // Independent transactions of equal size, tx i paying (i + 1) * 1000 in fees
+    const int num_txs = 100;
+    std::vector<CTransactionRef> txs;
+    for (int i = 0; i < num_txs; ++i) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx.vout[0].nValue = 10 * COIN;
+        txs.push_back(MakeTransactionRef(tx));
+        pool.addUnchecked(entry.Fee((i + 1) * 1000LL).FromTx(tx));
+    }
+    const std::chrono::seconds age{std::chrono::hours{DEFAULT_MEMPOOL_EXPIRY}};
+    const size_t usage = pool.DynamicMemoryUsage();
+
+    // Nothing is trimmed and no minimum fee is set while the pool is within its limit
+    LimitMempoolSize(pool, usage, age);
+    BOOST_CHECK_EQUAL(pool.size(), (size_t)num_txs);
+    BOOST_CHECK_EQUAL(pool.GetMinFee(usage).GetFeePerK(), 0);
+
+    // Once over the limit, the pool is trimmed to the low-water mark rather than just below the limit
+    const size_t limit = usage - 1;
+    const size_t target = limit / 100 * MEMPOOL_TRIM_LOW_WATER_PERCENT;
+    LimitMempoolSize(pool, limit, age);
+    BOOST_CHECK(pool.DynamicMemoryUsage() <= target);
+    BOOST_CHECK(pool.DynamicMemoryUsage() > target - usage / num_txs);
+    const size_t num_removed = num_txs - pool.size();
+    BOOST_CHECK(num_removed >= 2);
+
+    // The cheapest transactions went, and the minimum fee is bumped past the best of them
+    for (size_t i = 0; i < txs.size(); ++i) {
+        BOOST_CHECK_EQUAL(pool.exists(txs[i]->GetHash()), i >= num_removed);
+    }
+    const CFeeRate max_removed(num_removed * 1000, GetVirtualTransactionSize(*txs[num_removed - 1]));
+    BOOST_CHECK_EQUAL(pool.GetMinFee(limit).GetFeePerK(), max_removed.GetFeePerK() + DEFAULT_INCREMENTAL_RELAY_FEE);
+
+    // Back under the limit, the next acceptance does not trim again
+    LimitMempoolSize(pool, limit, age);
+    BOOST_CHECK_EQUAL(pool.size(), num_txs - num_removed);
+}
+
 BOOST_AUTO_TEST_CASE(MempoolAncestryTests)
 {
     size_t ancestors, descendants;
@@ -788,4 +842,58 @@ BOOST_AUTO_TEST_CASE(MempoolAncestryTests)
     BOOST_CHECK_EQUAL(descendants, 4ULL);
 }
 
+/** Write a mempool.dat holding a single entry, in the given format version. */
+static void WriteMempoolFile(uint64_t version, const CTransactionRef& tx)
+{
+    CAutoFile file(fsbridge::fopen(GetDataDir() / "mempool.dat", "wb"), SER_DISK, CLIENT_VERSION);
+    file << version << uint64_t{1} << *tx << int64_t{GetTime()} << int64_t{0};
+    file << std::map<uint256, CAmount>{};
+}
+
+BOOST_AUTO_TEST_CASE(MempoolPersistTest)
+{
+    CTxMemPool& pool = *m_node.mempool;
+
+    // Fund an anyone-can-spend P2SH output directly in the coins cache
+    const CScript redeem_script = CScript() << OP_TRUE;
+    const CScript p2sh = GetScriptForDestination(ScriptHash(redeem_script));
+    const COutPoint funding{InsecureRand256(), 0};
+    {
+        LOCK(cs_main);
+        ::ChainstateActive().CoinsTip().AddCoin(funding, Coin(CTxOut(10 * COIN, p2sh), 0, false, false), false);
+    }
+
+    CMutableTransaction mtx;
+    mtx.vin.emplace_back(funding, CScript() << std::vector<unsigned char>(redeem_script.begin(), redeem_script.end()));
+    mtx.vout.emplace_back(10 * COIN - 10000, p2sh);
+    const CTransactionRef tx = MakeTransactionRef(mtx);
+    {
+        LOCK(cs_main);
+        TxValidationState state;
+        BOOST_REQUIRE_MESSAGE(AcceptToMemoryPool(pool, state, tx, nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */),
+                              state.ToString());
+    }
+
+    // Round trip
+    BOOST_CHECK(DumpMempool(pool));
+    pool.clear();
+    BOOST_CHECK(LoadMempool(pool));
+    BOOST_CHECK(pool.exists(tx->GetHash()));
+
+    // Loaded transactions are fully validated: one spending the output with
+    // the wrong redeem script is rejected without failing the load
+    pool.clear();
+    CMutableTransaction bad_mtx{mtx};
+    bad_mtx.vin[0].scriptSig = CScript() << std::vector<unsigned char>{OP_2};
+    const CTransactionRef bad_tx = MakeTransactionRef(bad_mtx);
+    WriteMempoolFile(1, bad_tx);
+    BOOST_CHECK(LoadMempool(pool));
+    BOOST_CHECK(!pool.exists(bad_tx->GetHash()));
+
+    // Unknown versions are rejected
+    WriteMempoolFile(2, tx);
+    BOOST_CHECK(!LoadMempool(pool));
+    BOOST_CHECK(!pool.exists(tx->GetHash()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
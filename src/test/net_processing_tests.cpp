@@ -0,0 +1,376 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Unit tests for peer message processing in net_processing.cpp
+
+#include <blockencodings.h>
+#include <chainparams.h>
+#include <net.h>
+#include <net_processing.h>
+#include <netmessagemaker.h>
+#include <protocol.h>
+#include <streams.h>
+#include <txmempool.h>
+#include <util/memory.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <test/util/net.h>
+#include <test/util/setup_common.h>
+
+#include <algorithm>
+#include <set>
+#include <thread>
+
+#include <boost/test/unit_test.hpp>
+
+/** Forwards to PeerLogicValidation, recording which threads handled each peer and counting finished sends */
+class RecordingMsgProc final : public NetEventsInterface
+{
+public:
+    explicit RecordingMsgProc(PeerLogicValidation& peer_logic) : m_peer_logic(peer_logic) {}
+
+    bool ProcessMessages(CNode* pnode, std::atomic<bool>& interrupt) override
+    {
+        Record(pnode);
+        return m_peer_logic.ProcessMessages(pnode, interrupt);
+    }
+    bool SendMessages(CNode* pnode) override
+    {
+        Record(pnode);
+        const bool ret = m_peer_logic.SendMessages(pnode);
+        ++m_sends_done;
+        return ret;
+    }
+    void InitializeNode(CNode* pnode) override { m_peer_logic.InitializeNode(pnode); }
+    void FinalizeNode(NodeId id, bool& update_connection_time) override { m_peer_logic.FinalizeNode(id, update_connection_time); }
+
+    std::map<NodeId, std::set<std::thread::id>> GetThreads()
+    {
+        LOCK(m_mutex);
+        return m_threads;
+    }
+    int GetSendsDone() const { return m_sends_done; }
+
+private:
+    void Record(const CNode* pnode)
+    {
+        LOCK(m_mutex);
+        m_threads[pnode->GetId()].insert(std::this_thread::get_id());
+    }
+
+    PeerLogicValidation& m_peer_logic;
+    Mutex m_mutex;
+    std::map<NodeId, std::set<std::thread::id>> m_threads GUARDED_BY(m_mutex);
+    std::atomic<int> m_sends_done{0};
+};
+
+// Exposed by net_processing.cpp for these tests:
+extern std::shared_ptr<const std::vector<unsigned char>> GetCachedBlockSerialization(const uint256& hash, bool compact, bool witness);
+
+static NodeId id = 0;
+
+static CNode* AddPeer(PeerLogicValidation& peer_logic, ConnmanTestMsg& connman, bool inbound, SOCKET hSocket = INVALID_SOCKET)
+{
+    in_addr s;
+    s.s_addr = g_insecure_rand_ctx.randbits(32);
+    CAddress addr(CService(CNetAddr(s), Params().GetDefaultPort()), NODE_NONE);
+    CNode* node = new CNode(id++, ServiceFlags(NODE_NETWORK | NODE_WITNESS), 0, hSocket, addr, 0, 0, CAddress(), "", inbound);
+    node->SetSendVersion(PROTOCOL_VERSION);
+
+    peer_logic.InitializeNode(node);
+    node->nVersion = 1;
+    node->fSuccessfullyConnected = true;
+
+    connman.AddTestNode(*node);
+    return node;
+}
+
+/** A block with a coinbase and a transaction carrying a witness */
+static std::shared_ptr<CBlock> MakeWitnessBlock()
+{
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << OP_1 << OP_1;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 50 * COIN;
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+    spend.vin[0].scriptWitness.stack.push_back(std::vector<unsigned char>(72, 1));
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 49 * COIN;
+    auto block = std::make_shared<CBlock>();
+    block->hashPrevBlock = InsecureRand256();
+    block->vtx.push_back(MakeTransactionRef(coinbase));
+    block->vtx.push_back(MakeTransactionRef(spend));
+    return block;
+}
+
+/** The transactions announced by the INV messages that arrived on sock, in order */
+static std::vector<uint256> ReadTxInvs(SOCKET sock)
+{
+    std::vector<unsigned char> bytes;
+    char buf[4096];
+    ssize_t n;
+    while ((n = recv(sock, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+        bytes.insert(bytes.end(), buf, buf + n);
+    }
+
+    std::vector<uint256> txids;
+    CDataStream stream(bytes, SER_NETWORK, PROTOCOL_VERSION);
+    while (!stream.empty()) {
+        CMessageHeader header(Params().MessageStart());
+        stream >> header;
+        CDataStream payload(stream.begin(), stream.begin() + header.nMessageSize, SER_NETWORK, PROTOCOL_VERSION);
+        stream.ignore(header.nMessageSize);
+        if (header.GetCommand() != NetMsgType::INV) continue;
+        std::vector<CInv> invs;
+        payload >> invs;
+        for (const CInv& inv : invs) {
+            if (inv.type == MSG_TX) txids.push_back(inv.hash);
+        }
+    }
+    return txids;
+}
+
+BOOST_FIXTURE_TEST_SUITE(net_processing_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(message_handler_threads)
+{
+    for (const int num_threads : {1, 3}) {
+        auto connman = MakeUnique<ConnmanTestMsg>(0x1337, 0x1337);
+        auto peerLogic = MakeUnique<PeerLogicValidation>(connman.get(), nullptr, *m_node.scheduler, *m_node.mempool);
+        RecordingMsgProc msgproc(*peerLogic);
+
+        CConnman::Options options;
+        options.nMaxConnections = 125;
+        options.m_max_outbound_full_relay = 8;
+        options.m_msgproc_threads = num_threads;
+        connman->Init(options);
+
+        const int num_peers = 3 * num_threads;
+        std::vector<CNode*> vNodes;
+        for (int i = 0; i < num_peers; ++i) {
+            vNodes.push_back(AddPeer(*peerLogic, *connman, /* inbound */ false));
+            vNodes.back()->fPingQueued = true;
+        }
+
+        {
+            // The workers start while cs_main is held elsewhere.
+            LOCK(cs_main);
+            connman->StartTestMessageHandlers(&msgproc, num_threads);
+            UninterruptibleSleep(std::chrono::milliseconds{300});
+            if (num_threads == 1) {
+                // A single thread skips the cs_main part of SendMessages and
+                // moves on, retrying the peers at a later wake...
+                BOOST_CHECK(msgproc.GetSendsDone() >= num_peers);
+            } else {
+                // ...while several threads wait for cs_main.
+                BOOST_CHECK_EQUAL(msgproc.GetSendsDone(), 0);
+            }
+        }
+
+        // Every peer gets its queued ping and its first addr broadcast scheduled,
+        // the latter only happening after cs_main was taken.
+        const auto all_served = [&] {
+            for (CNode* node : vNodes) {
+                LOCK(node->cs_sendProcessing);
+                if (node->fPingQueued || node->m_next_addr_send == std::chrono::microseconds{0}) return false;
+            }
+            return true;
+        };
+        for (int i = 0; i < 200 && !all_served(); ++i) {
+            UninterruptibleSleep(std::chrono::milliseconds{50});
+        }
+        connman->StopTestMessageHandlers();
+        BOOST_CHECK(all_served());
+
+        // Each peer was handled by exactly one worker, and all workers were used
+        const auto threads = msgproc.GetThreads();
+        BOOST_CHECK_EQUAL(threads.size(), (size_t)num_peers);
+        std::set<std::thread::id> all_threads;
+        for (const auto& entry : threads) {
+            BOOST_CHECK_EQUAL(entry.second.size(), 1U);
+            all_threads.insert(entry.second.begin(), entry.second.end());
+        }
+        BOOST_CHECK_EQUAL(all_threads.size(), (size_t)num_threads);
+
+        bool dummy;
+        for (const CNode* node : vNodes) {
+            peerLogic->FinalizeNode(node->GetId(), dummy);
+        }
+        connman->ClearTestNodes();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(block_download_window)
+{
+    // Peers without a measured service time get the fixed default window
+    BOOST_CHECK_EQUAL(GetBlocksInTransitLimit(0), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+    // Otherwise about four seconds of work are kept queued, within [2, 64]
+    BOOST_CHECK_EQUAL(GetBlocksInTransitLimit(10000), 64);
+    BOOST_CHECK_EQUAL(GetBlocksInTransitLimit(100000), 40);
+    BOOST_CHECK_EQUAL(GetBlocksInTransitLimit(1000000), 4);
+    BOOST_CHECK_EQUAL(GetBlocksInTransitLimit(10000000), 2);
+
+    const int64_t requested = 1000000000;
+    // Unmeasured peers never take over a straggling block
+    BOOST_CHECK(!ShouldRerequestStalledBlock(0, requested, requested + 60000000));
+    // A fast peer takes it over once it has been outstanding for at least a second...
+    BOOST_CHECK(!ShouldRerequestStalledBlock(100000, requested, requested + 500000));
+    BOOST_CHECK(ShouldRerequestStalledBlock(100000, requested, requested + 1500000));
+    // ...and for four times that peer's own service time
+    BOOST_CHECK(!ShouldRerequestStalledBlock(500000, requested, requested + 1500000));
+    BOOST_CHECK(ShouldRerequestStalledBlock(500000, requested, requested + 2500000));
+}
+
+BOOST_AUTO_TEST_CASE(serialized_block_cache)
+{
+    auto connman = MakeUnique<ConnmanTestMsg>(0x1337, 0x1337);
+    auto peerLogic = MakeUnique<PeerLogicValidation>(connman.get(), nullptr, *m_node.scheduler, *m_node.mempool);
+
+    const std::shared_ptr<CBlock> block = MakeWitnessBlock();
+    const uint256 hash = block->GetHash();
+    BOOST_CHECK(!GetCachedBlockSerialization(hash, /* compact */ false, /* witness */ true));
+    peerLogic->BlockConnected(block, nullptr);
+
+    // Full blocks match what would be pushed without the cache
+    const CNetMsgMaker msg_maker(PROTOCOL_VERSION);
+    const auto witness = GetCachedBlockSerialization(hash, /* compact */ false, /* witness */ true);
+    const auto no_witness = GetCachedBlockSerialization(hash, /* compact */ false, /* witness */ false);
+    BOOST_REQUIRE(witness && no_witness);
+    BOOST_CHECK(*witness == msg_maker.Make(NetMsgType::BLOCK, *block).data);
+    BOOST_CHECK(*no_witness == msg_maker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *block).data);
+    BOOST_CHECK(*no_witness != *witness);
+    // Each form is serialized once and shared
+    BOOST_CHECK_EQUAL(GetCachedBlockSerialization(hash, /* compact */ false, /* witness */ true), witness);
+
+    // Compact blocks carry a random nonce, so check them against the block instead
+    for (const bool use_wtxid : {true, false}) {
+        const auto cmpct_data = GetCachedBlockSerialization(hash, /* compact */ true, use_wtxid);
+        BOOST_REQUIRE(cmpct_data);
+        CBlockHeaderAndShortTxIDs cmpct;
+        CDataStream stream(*cmpct_data, SER_NETWORK, PROTOCOL_VERSION);
+        stream >> cmpct;
+        BOOST_CHECK(msg_maker.Make(use_wtxid ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::CMPCTBLOCK, cmpct).data == *cmpct_data);
+        BOOST_CHECK(cmpct.header.GetHash() == hash);
+        BOOST_CHECK_EQUAL(cmpct.BlockTxCount(), block->vtx.size());
+        // The short id list follows the header, nonce and its compact size
+        const uint256& tx_hash = use_wtxid ? block->vtx[1]->GetWitnessHash() : block->vtx[1]->GetHash();
+        CDataStream short_ids(*cmpct_data, SER_NETWORK, PROTOCOL_VERSION);
+        short_ids.ignore(::GetSerializeSize(cmpct.header, PROTOCOL_VERSION) + 8);
+        BOOST_CHECK_EQUAL(ReadCompactSize(short_ids), 1U);
+        uint64_t short_id = 0;
+        for (int i = 0; i < 6; ++i) {
+            short_id |= uint64_t{ser_readdata8(short_ids)} << (8 * i);
+        }
+        BOOST_CHECK_EQUAL(short_id, cmpct.GetShortID(tx_hash));
+    }
+
+    // Disconnecting the block drops it from the cache
+    peerLogic->BlockDisconnected(block, nullptr);
+    BOOST_CHECK(!GetCachedBlockSerialization(hash, /* compact */ false, /* witness */ true));
+
+    // Only the last SERIALIZED_BLOCK_CACHE_SIZE (10) connected blocks are kept
+    std::vector<std::shared_ptr<CBlock>> blocks;
+    for (int i = 0; i < 11; ++i) {
+        blocks.push_back(MakeWitnessBlock());
+        peerLogic->BlockConnected(blocks.back(), nullptr);
+    }
+    BOOST_CHECK(!GetCachedBlockSerialization(blocks[0]->GetHash(), /* compact */ false, /* witness */ true));
+    for (size_t i = 1; i < blocks.size(); ++i) {
+        BOOST_CHECK(GetCachedBlockSerialization(blocks[i]->GetHash(), /* compact */ false, /* witness */ true));
+    }
+    for (const auto& connected : blocks) {
+        peerLogic->BlockDisconnected(connected, nullptr);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(tx_relay_order)
+{
+    auto connman = MakeUnique<ConnmanTestMsg>(0x1337, 0x1337);
+    auto peerLogic = MakeUnique<PeerLogicValidation>(connman.get(), nullptr, *m_node.scheduler, *m_node.mempool);
+    CTxMemPool& mempool = *m_node.mempool;
+    // Frozen time keeps the shared relay order from being refreshed
+    SetMockTime(GetTime());
+
+    const auto make_tx = [](const COutPoint& prevout, size_t script_size) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = prevout;
+        tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(script_size, 1);
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        tx.vout[0].nValue = COIN;
+        return MakeTransactionRef(tx);
+    };
+    std::vector<CTransactionRef> txs;
+    {
+        TestMemPoolEntryHelper entry;
+        LOCK2(cs_main, mempool.cs);
+        const CAmount fees[] = {1000, 5000, 100, 3000, 2000};
+        for (int i = 0; i < 5; ++i) {
+            txs.push_back(make_tx(COutPoint(InsecureRand256(), 0), 10 + 20 * i));
+            mempool.addUnchecked(entry.Fee(fees[i]).FromTx(txs.back()));
+        }
+        // The child with the highest feerate still goes after its parent
+        txs.push_back(make_tx(COutPoint(txs[1]->GetHash(), 0), 10));
+        mempool.addUnchecked(entry.Fee(100000).FromTx(txs.back()));
+    }
+    // The lowest fee transaction is prioritised ahead of all others
+    mempool.PrioritiseTransaction(txs[2]->GetHash(), 50000);
+
+    int socks[2][2];
+    std::vector<CNode*> peers;
+    for (int i = 0; i < 2; ++i) {
+        BOOST_REQUIRE_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, socks[i]), 0);
+        peers.push_back(AddPeer(*peerLogic, *connman, /* inbound */ true, socks[i][0]));
+        LOCK(peers.back()->m_tx_relay->cs_filter);
+        peers.back()->m_tx_relay->fRelayTxes = true;
+    }
+    const auto trickle = [&](CNode* peer, const std::vector<CTransactionRef>& queued) {
+        {
+            LOCK(peer->m_tx_relay->cs_tx_inventory);
+            for (const CTransactionRef& tx : queued) {
+                peer->m_tx_relay->setInventoryTxToSend.insert(tx->GetHash());
+            }
+        }
+        LOCK(peer->cs_sendProcessing);
+        peerLogic->SendMessages(peer);
+    };
+
+    // Announcements follow CTxMemPool::CompareDepthAndScore, including fee deltas
+    trickle(peers[0], txs);
+    std::vector<uint256> expected;
+    for (const CTransactionRef& tx : txs) {
+        expected.push_back(tx->GetHash());
+    }
+    std::sort(expected.begin(), expected.end(), [&](const uint256& a, const uint256& b) { return mempool.CompareDepthAndScore(a, b); });
+    BOOST_CHECK(expected.front() == txs[2]->GetHash());
+    BOOST_CHECK(expected.back() == txs[5]->GetHash());
+    BOOST_CHECK(ReadTxInvs(socks[0][1]) == expected);
+
+    // A transaction that left the mempool after the shared order looked it up
+    // is still in that order, but is not announced.
+    {
+        LOCK(mempool.cs);
+        mempool.removeRecursive(*txs[3], MemPoolRemovalReason::CONFLICT);
+    }
+    trickle(peers[1], {txs[0], txs[3]});
+    BOOST_CHECK(ReadTxInvs(socks[1][1]) == std::vector<uint256>{txs[0]->GetHash()});
+
+    bool dummy;
+    for (const CNode* peer : peers) {
+        peerLogic->FinalizeNode(peer->GetId(), dummy);
+    }
+    connman->ClearTestNodes();
+    for (int i = 0; i < 2; ++i) {
+        close(socks[i][1]);
+    }
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
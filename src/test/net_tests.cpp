@@ -13,6 +13,7 @@
 #include <net.h>
 #include <netbase.h>
 #include <chainparams.h>
+#include <test/util/net.h>
 #include <util/memory.h>
 #include <util/system.h>
 #include <util/string.h>
@@ -77,6 +78,31 @@ static CDataStream AddrmanToStream(CAddrManSerializationMock& _addrman)
     return CDataStream(vchData, SER_DISK, CLIENT_VERSION);
 }
 
+#ifdef USE_EPOLL
+/** Queues a message far larger than a socket buffer as soon as a peer is set up, like VERSION but bigger */
+class LargeFirstMessage final : public NetEventsInterface
+{
+public:
+    explicit LargeFirstMessage(CConnman& connman) : m_connman(connman) {}
+
+    bool ProcessMessages(CNode* pnode, std::atomic<bool>& interrupt) override { return false; }
+    bool SendMessages(CNode* pnode) override { return true; }
+    void InitializeNode(CNode* pnode) override
+    {
+        CSerializedNetMsg msg;
+        msg.command = "filler";
+        msg.data.resize(PAYLOAD_SIZE);
+        m_connman.PushMessage(pnode, std::move(msg));
+    }
+    void FinalizeNode(NodeId id, bool& update_connection_time) override {}
+
+    static constexpr size_t PAYLOAD_SIZE = 32 << 20;
+
+private:
+    CConnman& m_connman;
+};
+#endif
+
 BOOST_FIXTURE_TEST_SUITE(net_tests, BasicTestingSetup)
 
 BOOST_AUTO_TEST_CASE(cnode_listen_port)
@@ -319,4 +345,121 @@ BOOST_AUTO_TEST_CASE(PoissonNextSend)
     g_mock_deterministic_tests = false;
 }
 
+BOOST_AUTO_TEST_CASE(transport_deserializer_recycles_buffers)
+{
+    V1TransportSerializer serializer;
+    V1TransportDeserializer deserializer{Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION};
+    auto receive = [&](const std::vector<unsigned char>& payload) {
+        CSerializedNetMsg msg;
+        msg.command = NetMsgType::TX;
+        msg.data = payload;
+        std::vector<unsigned char> wire;
+        serializer.prepareForTransport(msg, wire);
+        wire.insert(wire.end(), msg.data.begin(), msg.data.end());
+        const char* pch = (const char*)wire.data();
+        unsigned int n_bytes = wire.size();
+        while (n_bytes > 0) {
+            const int handled = deserializer.Read(pch, n_bytes);
+            BOOST_REQUIRE(handled > 0);
+            pch += handled;
+            n_bytes -= handled;
+        }
+        BOOST_REQUIRE(deserializer.Complete());
+        return deserializer.GetMessage(Params().MessageStart(), 0);
+    };
+
+    const char* first_buffer;
+    {
+        CNetMessage msg = receive(std::vector<unsigned char>(200, 0x01));
+        BOOST_CHECK(msg.m_valid_checksum);
+        first_buffer = msg.m_recv.data();
+    }
+    // The processed message gave its buffer back; the next one reuses it
+    CNetMessage msg = receive(std::vector<unsigned char>(150, 0x02));
+    BOOST_CHECK(msg.m_valid_checksum);
+    BOOST_CHECK_EQUAL((const void*)msg.m_recv.data(), (const void*)first_buffer);
+    BOOST_CHECK_EQUAL(msg.m_recv.size(), 150U);
+    BOOST_CHECK_EQUAL(msg.m_recv[149], 0x02);
+}
+
+BOOST_AUTO_TEST_CASE(msg_time_histogram)
+{
+    MsgTimeHistogram hist;
+    hist.Add(-5); // clock went backwards
+    hist.Add(0);
+    hist.Add(1);
+    hist.Add(3);
+    hist.Add(4);
+    hist.Add(1000);
+    hist.Add(int64_t{1} << 40);
+    BOOST_CHECK_EQUAL(hist.count, 7U);
+    BOOST_CHECK_EQUAL(hist.buckets[0], 2U);  // < 1us
+    BOOST_CHECK_EQUAL(hist.buckets[1], 1U);  // [1, 2)
+    BOOST_CHECK_EQUAL(hist.buckets[2], 1U);  // [2, 4)
+    BOOST_CHECK_EQUAL(hist.buckets[3], 1U);  // [4, 8)
+    BOOST_CHECK_EQUAL(hist.buckets[10], 1U); // [512, 1024)
+    BOOST_CHECK_EQUAL(hist.buckets[MsgTimeHistogram::BUCKETS - 1], 1U);
+}
+
+#ifdef USE_EPOLL
+BOOST_AUTO_TEST_CASE(epoll_partial_first_send)
+{
+    // A loopback listener that does not read until told to. Not on 127.0.0.1,
+    // which earlier tests leave in mapLocalHost and which is never connected to.
+    SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    BOOST_REQUIRE(listener != INVALID_SOCKET);
+    struct sockaddr_in listen_addr = {};
+    listen_addr.sin_family = AF_INET;
+    listen_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK + 1);
+    BOOST_REQUIRE_EQUAL(bind(listener, (struct sockaddr*)&listen_addr, sizeof(listen_addr)), 0);
+    BOOST_REQUIRE_EQUAL(listen(listener, 1), 0);
+    socklen_t listen_addr_len = sizeof(listen_addr);
+    BOOST_REQUIRE_EQUAL(getsockname(listener, (struct sockaddr*)&listen_addr, &listen_addr_len), 0);
+
+    ConnmanTestMsg connman(0x1337, 0x1337);
+    LargeFirstMessage msgproc(connman);
+    CConnman::Options options;
+    options.m_msgproc = &msgproc;
+    connman.Init(options);
+    const int epoll_fd = connman.InitTestSocketEvents();
+    BOOST_REQUIRE(epoll_fd >= 0);
+
+    // The first message does not fit into the socket buffers, so the
+    // optimistic send in InitializeNode only writes part of it. The socket
+    // must already be registered so that EPOLLOUT gets armed for the rest.
+    connman.OpenNetworkConnection(CAddress(CService(CNetAddr(listen_addr.sin_addr), ntohs(listen_addr.sin_port)), NODE_NONE), false);
+    const std::vector<CNode*> nodes = connman.GetTestNodes();
+    BOOST_REQUIRE_EQUAL(nodes.size(), 1U);
+    CNode* node = nodes[0];
+    SOCKET node_socket;
+    {
+        LOCK(node->cs_hSocket);
+        node_socket = node->hSocket;
+    }
+    {
+        LOCK(node->cs_vSend);
+        BOOST_REQUIRE(!node->vSendMsg.empty());
+        BOOST_CHECK(node->m_send_events_armed);
+    }
+
+    // Once the remote end reads, the socket reports writable again.
+    SOCKET remote = accept(listener, nullptr, nullptr);
+    BOOST_REQUIRE(remote != INVALID_SOCKET);
+    std::vector<char> buf(1 << 20);
+    BOOST_REQUIRE(recv(remote, buf.data(), buf.size(), MSG_WAITALL) > 0);
+    bool writable = false;
+    struct epoll_event events[4];
+    for (int tries = 0; tries < 50 && !writable; ++tries) {
+        const int n = epoll_wait(epoll_fd, events, 4, 100);
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.fd == node_socket && (events[i].events & EPOLLOUT)) writable = true;
+        }
+    }
+    BOOST_CHECK(writable);
+
+    CloseSocket(remote);
+    CloseSocket(listener);
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,13 @@
 #include <sync.h>
 #include <test/util/setup_common.h>
 
+#include <chrono>
+#include <thread>
+
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
 #include <boost/test/unit_test.hpp>
 
 namespace {
@@ -49,4 +56,25 @@ BOOST_AUTO_TEST_CASE(potential_deadlock_detected)
     #endif
 }
 
+BOOST_AUTO_TEST_CASE(timed_recursive_mutex_held_time)
+{
+    TimedRecursiveMutex mutex;
+
+    const int64_t before = TimedRecursiveMutex::GetThreadHeldTime();
+    {
+        LOCK(mutex);
+        {
+            LOCK(mutex);
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+    const int64_t held = TimedRecursiveMutex::GetThreadHeldTime() - before;
+#if defined(HAVE_THREAD_LOCAL)
+    BOOST_CHECK_GE(held, 20000);
+#else
+    BOOST_CHECK_EQUAL(held, 0);
+#endif
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,7 @@
 #include <script/sign.h>
 #include <script/signingprovider.h>
 #include <test/util/setup_common.h>
+#include <util/system.h>
 
 #include <boost/test/unit_test.hpp>
 
@@ -371,4 +372,52 @@ BOOST_FIXTURE_TEST_CASE(checkinputs_test, TestChain100Setup)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(script_caches_persist, TestingSetup)
+{
+    // A freshly dumped cache file loads back.
+    BOOST_CHECK(DumpScriptCaches());
+    BOOST_CHECK(LoadScriptCaches());
+
+    // Corrupting the payload is caught by the MAC.
+    FILE* file = fsbridge::fopen(GetDataDir() / "sigcache.dat", "r+b");
+    BOOST_REQUIRE(file != nullptr);
+    BOOST_REQUIRE_EQUAL(fseek(file, 16, SEEK_SET), 0);
+    int c = fgetc(file);
+    BOOST_REQUIRE_EQUAL(fseek(file, 16, SEEK_SET), 0);
+    fputc(c ^ 0xff, file);
+    fclose(file);
+    BOOST_CHECK(!LoadScriptCaches());
+
+    // An intact cache file is rejected under any key other than the one it
+    // was dumped with, and without a key at all.
+    BOOST_CHECK(DumpScriptCaches());
+    file = fsbridge::fopen(GetDataDir() / "sigcache.key", "wb");
+    BOOST_REQUIRE(file != nullptr);
+    const uint256 other_key = InsecureRand256();
+    BOOST_REQUIRE_EQUAL(fwrite(other_key.begin(), 1, other_key.size(), file), other_key.size());
+    fclose(file);
+    BOOST_CHECK(!LoadScriptCaches());
+    fs::remove(GetDataDir() / "sigcache.key");
+    BOOST_CHECK(!LoadScriptCaches());
+
+    // Every dump uses a fresh key.
+    BOOST_CHECK(DumpScriptCaches());
+    std::vector<char> first_key(32), second_key(32);
+    file = fsbridge::fopen(GetDataDir() / "sigcache.key", "rb");
+    BOOST_REQUIRE(file != nullptr);
+    BOOST_REQUIRE_EQUAL(fread(first_key.data(), 1, first_key.size(), file), first_key.size());
+    fclose(file);
+    BOOST_CHECK(DumpScriptCaches());
+    file = fsbridge::fopen(GetDataDir() / "sigcache.key", "rb");
+    BOOST_REQUIRE(file != nullptr);
+    BOOST_REQUIRE_EQUAL(fread(second_key.data(), 1, second_key.size(), file), second_key.size());
+    fclose(file);
+    BOOST_CHECK(first_key != second_key);
+    BOOST_CHECK(LoadScriptCaches());
+
+    // A missing file loads nothing.
+    fs::remove(GetDataDir() / "sigcache.dat");
+    BOOST_CHECK(!LoadScriptCaches());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
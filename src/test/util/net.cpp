@@ -7,6 +7,29 @@
 #include <chainparams.h>
 #include <net.h>
 
+void ConnmanTestMsg::StartTestMessageHandlers(NetEventsInterface* msgproc, int threads)
+{
+    m_msgproc = msgproc;
+    m_msgproc_threads = threads;
+    flagInterruptMsgProc = false;
+    for (int i = 0; i < threads; ++i) {
+        threadMessageHandlers.emplace_back([this, i] { ThreadMessageHandler(i); });
+    }
+}
+
+void ConnmanTestMsg::StopTestMessageHandlers()
+{
+    {
+        LOCK(mutexMsgProc);
+        flagInterruptMsgProc = true;
+    }
+    condMsgProc.notify_all();
+    for (std::thread& thread : threadMessageHandlers) {
+        thread.join();
+    }
+    threadMessageHandlers.clear();
+}
+
 void ConnmanTestMsg::NodeReceiveMsgBytes(CNode& node, const char* pch, unsigned int nBytes, bool& complete) const
 {
     assert(node.ReceiveMsgBytes(pch, nBytes, complete));
@@ -7,6 +7,10 @@
 
 #include <net.h>
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 struct ConnmanTestMsg : public CConnman {
     using CConnman::CConnman;
     void AddTestNode(CNode& node)
@@ -22,6 +26,23 @@ struct ConnmanTestMsg : public CConnman {
         }
         vNodes.clear();
     }
+    std::vector<CNode*> GetTestNodes()
+    {
+        LOCK(cs_vNodes);
+        return vNodes;
+    }
+#ifdef USE_EPOLL
+    //! Create the epoll set without binding or starting any threads
+    int InitTestSocketEvents()
+    {
+        m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        return m_epoll_fd;
+    }
+#endif
+
+    /** Run threads message handler threads on msgproc, without the socket threads */
+    void StartTestMessageHandlers(NetEventsInterface* msgproc, int threads);
+    void StopTestMessageHandlers();
 
     void ProcessMessagesOnce(CNode& node) { m_msgproc->ProcessMessages(&node, flagInterruptMsgProc); }
 
@@ -133,6 +133,7 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
         threadGroup.create_thread([i]() { return ThreadScriptCheck(i); });
     }
     g_parallel_script_checks = true;
+    g_script_check_threads = script_check_threads;
 
     m_node.mempool = &::mempool;
     m_node.mempool->setSanityCheck(1.0);
@@ -167,7 +168,7 @@ TestChain100Setup::TestChain100Setup()
 {
     // CreateAndProcessBlock() does not support building SegWit blocks, so don't activate in these tests.
     // TODO: fix the code to support SegWit blocks.
-    gArgs.ForceSetArg("-segwitheight", "432");
+    gArgs.ForceSetArg("-segwitheight", ToString(COINBASE_MATURITY + 332));
     // Need to recreate chainparams
     SelectParams(CBaseChainParams::REGTEST);
 
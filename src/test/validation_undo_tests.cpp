@@ -0,0 +1,228 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Unit tests for disconnecting blocks with in-memory and on-disk undo data
+
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <key.h>
+#include <node/coinstats.h>
+#include <script/interpreter.h>
+#include <streams.h>
+#include <undo.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+extern std::shared_ptr<const CBlockUndo> GetCachedBlockUndo(const CBlockIndex* pindex);
+
+namespace {
+struct UndoTestingSetup : public TestChain100Setup {
+    /**
+     * Mine a block with one transaction that spends the next mature coinbase
+     * and the change of the previous call, so that its undo data restores
+     * both a coinbase and a regular coin.
+     */
+    CBlockIndex* MineSpendingBlock();
+    /** Hash of the flushed UTXO set. */
+    uint256 UTXOHash();
+
+    COutPoint m_change;
+    size_t m_next_coinbase{0};
+};
+
+CBlockIndex* UndoTestingSetup::MineSpendingBlock()
+{
+    const CScript script_pub_key = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction tx;
+    tx.nVersion = 1;
+    tx.vin.emplace_back(COutPoint(m_coinbase_txns.at(m_next_coinbase++)->GetHash(), 0));
+    if (!m_change.IsNull()) tx.vin.emplace_back(m_change);
+    tx.vout.resize(2);
+    tx.vout[0].nValue = 5 * CENT;
+    tx.vout[0].scriptPubKey = script_pub_key;
+    tx.vout[1].nValue = 5 * CENT;
+    tx.vout[1].scriptPubKey = script_pub_key;
+    for (unsigned int i = 0; i < tx.vin.size(); ++i) {
+        std::vector<unsigned char> sig;
+        BOOST_CHECK(coinbaseKey.Sign(SignatureHash(script_pub_key, tx, i, SIGHASH_ALL, 0, SigVersion::BASE), sig));
+        sig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[i].scriptSig = CScript() << sig;
+    }
+    m_change = COutPoint(tx.GetHash(), 1);
+
+    const CBlock block = CreateAndProcessBlock({tx}, script_pub_key);
+    LOCK(cs_main);
+    BOOST_REQUIRE(::ChainActive().Tip()->GetBlockHash() == block.GetHash());
+    return ::ChainActive().Tip();
+}
+
+uint256 UndoTestingSetup::UTXOHash()
+{
+    ::ChainstateActive().ForceFlushStateToDisk();
+    LOCK(cs_main);
+    CCoinsStats stats;
+    BOOST_REQUIRE(GetUTXOStats(&::ChainstateActive().CoinsDB(), stats));
+    return stats.hashSerialized;
+}
+
+std::vector<unsigned char> SerializeUndo(const CBlockUndo& undo)
+{
+    std::vector<unsigned char> data;
+    CVectorWriter(SER_DISK, CLIENT_VERSION, data, 0) << undo;
+    return data;
+}
+
+/** Check that exactly blocks[first_cached..] are cached, each with the undo data on disk. */
+void CheckCachedUndo(const std::vector<CBlockIndex*>& blocks, size_t first_cached)
+{
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        const std::shared_ptr<const CBlockUndo> cached = GetCachedBlockUndo(blocks[i]);
+        BOOST_CHECK_EQUAL(cached != nullptr, i >= first_cached);
+        if (!cached) continue;
+        CBlockUndo disk;
+        BOOST_REQUIRE(UndoReadFromDisk(disk, blocks[i]));
+        BOOST_CHECK(SerializeUndo(*cached) == SerializeUndo(disk));
+    }
+}
+
+/** Invert the byte at `offset` past `pos` in the blk or rev file it points into. */
+void CorruptByte(const char* prefix, const FlatFilePos& pos, unsigned int offset)
+{
+    FILE* file = fsbridge::fopen(GetBlocksDir() / strprintf("%s%05u.dat", prefix, pos.nFile), "rb+");
+    BOOST_REQUIRE(file);
+    BOOST_REQUIRE_EQUAL(fseek(file, pos.nPos + offset, SEEK_SET), 0);
+    const int byte = fgetc(file);
+    BOOST_REQUIRE(byte != EOF);
+    BOOST_REQUIRE_EQUAL(fseek(file, pos.nPos + offset, SEEK_SET), 0);
+    BOOST_REQUIRE_EQUAL(fputc(~byte & 0xff, file), ~byte & 0xff);
+    fclose(file);
+}
+
+bool VerifyChain(int check_level, int check_depth)
+{
+    LOCK(cs_main);
+    return CVerifyDB().VerifyDB(Params(), &::ChainstateActive().CoinsTip(), check_level, check_depth);
+}
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(validation_undo_tests, UndoTestingSetup)
+
+BOOST_AUTO_TEST_CASE(recent_undo_cache_reorg)
+{
+    const uint256 utxo_before = UTXOHash();
+
+    // Connect two blocks more than the cache holds, evicting the oldest ones
+    std::vector<CBlockIndex*> blocks;
+    for (int i = 0; i < 12; ++i) {
+        blocks.push_back(MineSpendingBlock());
+    }
+    const uint256 utxo_after = UTXOHash();
+    BOOST_CHECK(utxo_after != utxo_before);
+    CheckCachedUndo(blocks, /* first_cached */ 2);
+
+    // Disconnecting with the cached undo data must give the same coins as
+    // with the undo data read from disk
+    {
+        LOCK(cs_main);
+        CCoinsViewCache view_cached(&::ChainstateActive().CoinsTip());
+        CCoinsViewCache view_disk(&::ChainstateActive().CoinsTip());
+        std::vector<COutPoint> touched;
+        for (auto it = blocks.rbegin(); it != blocks.rend(); ++it) {
+            CBlock block;
+            BOOST_REQUIRE(ReadBlockFromDisk(block, *it, Params().GetConsensus()));
+            CBlockUndo undo;
+            BOOST_REQUIRE(UndoReadFromDisk(undo, *it));
+            BOOST_CHECK_EQUAL(::ChainstateActive().DisconnectBlock(block, *it, view_cached), DISCONNECT_OK);
+            BOOST_CHECK_EQUAL(::ChainstateActive().DisconnectBlock(block, *it, view_disk, &undo), DISCONNECT_OK);
+            for (const CTransactionRef& tx : block.vtx) {
+                for (const CTxIn& txin : tx->vin) touched.push_back(txin.prevout);
+                for (uint32_t n = 0; n < tx->vout.size(); ++n) touched.emplace_back(tx->GetHash(), n);
+            }
+        }
+        for (const COutPoint& outpoint : touched) {
+            const Coin& cached = view_cached.AccessCoin(outpoint);
+            const Coin& disk = view_disk.AccessCoin(outpoint);
+            BOOST_CHECK_EQUAL(cached.IsSpent(), disk.IsSpent());
+            if (cached.IsSpent() || disk.IsSpent()) continue;
+            BOOST_CHECK(cached.out == disk.out);
+            BOOST_CHECK_EQUAL(cached.nHeight, disk.nHeight);
+            BOOST_CHECK_EQUAL(cached.IsCoinBase(), disk.IsCoinBase());
+        }
+    }
+
+    // Reorg the blocks out: ten disconnect from the cache, two from disk
+    BlockValidationState state;
+    BOOST_REQUIRE(InvalidateBlock(state, Params(), blocks.front()));
+    BOOST_CHECK(UTXOHash() == utxo_before);
+    CheckCachedUndo(blocks, /* first_cached */ blocks.size());
+
+    // Reconnecting them fills the cache again
+    {
+        LOCK(cs_main);
+        ResetBlockFailureFlags(blocks.front());
+    }
+    BOOST_REQUIRE(ActivateBestChain(state, Params()));
+    BOOST_REQUIRE(WITH_LOCK(cs_main, return ::ChainActive().Tip()) == blocks.back());
+    BOOST_CHECK(UTXOHash() == utxo_after);
+    CheckCachedUndo(blocks, /* first_cached */ 2);
+
+    // VerifyDB at level 4 reconnects the blocks into a scratch view, which
+    // must leave the cache with the same undo data as on disk
+    BOOST_CHECK(VerifyChain(4, blocks.size()));
+    CheckCachedUndo(blocks, /* first_cached */ 2);
+    BOOST_CHECK(UTXOHash() == utxo_after);
+
+    BOOST_REQUIRE(InvalidateBlock(state, Params(), blocks.front()));
+    BOOST_CHECK(UTXOHash() == utxo_before);
+}
+
+BOOST_AUTO_TEST_CASE(verifydb_levels)
+{
+    // Blocks are read ahead on the script check threads
+    BOOST_REQUIRE(g_script_check_threads > 0);
+
+    // More blocks with transactions than the read-ahead window holds
+    std::vector<CBlockIndex*> blocks;
+    for (int i = 0; i < 40; ++i) {
+        blocks.push_back(MineSpendingBlock());
+    }
+    const uint256 utxo = UTXOHash();
+    const CBlockIndex* const tip = blocks.back();
+
+    // Levels 3 and 4 over the spending blocks and over the whole chain, which
+    // must leave the chain state untouched
+    for (int check_level : {3, 4}) {
+        BOOST_CHECK(VerifyChain(check_level, blocks.size()));
+        BOOST_CHECK(VerifyChain(check_level, /* check_depth */ 0));
+        BOOST_CHECK(WITH_LOCK(cs_main, return ::ChainActive().Tip()) == tip);
+        BOOST_CHECK(UTXOHash() == utxo);
+    }
+
+    // Corrupt undo data is found from level 2 on, and only within the depth
+    CBlockIndex* const corrupt = blocks[blocks.size() - 10];
+    const FlatFilePos undo_pos = WITH_LOCK(cs_main, return corrupt->GetUndoPos());
+    CorruptByte("rev", undo_pos, 1);
+    BOOST_CHECK(!VerifyChain(3, 20));
+    BOOST_CHECK(!VerifyChain(4, 20));
+    BOOST_CHECK(VerifyChain(1, 20));
+    BOOST_CHECK(VerifyChain(4, 5));
+    CorruptByte("rev", undo_pos, 1);
+    BOOST_CHECK(VerifyChain(4, 20));
+
+    // So is a corrupt block, from level 0 on
+    const FlatFilePos block_pos = WITH_LOCK(cs_main, return corrupt->GetBlockPos());
+    CorruptByte("blk", block_pos, 40);
+    BOOST_CHECK(!VerifyChain(0, 20));
+    BOOST_CHECK(!VerifyChain(4, 20));
+    BOOST_CHECK(VerifyChain(4, 5));
+    CorruptByte("blk", block_pos, 40);
+    BOOST_CHECK(VerifyChain(4, 20));
+    BOOST_CHECK(UTXOHash() == utxo);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -19,12 +19,17 @@
 #include <util/time.h>
 #include <validationinterface.h>
 
+#include <limits>
+
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                                  int64_t _nTime, unsigned int _entryHeight,
                                  bool _spendsCoinbase, int64_t _sigOpsCost, LockPoints lp)
-    : tx(_tx), nFee(_nFee), nTxWeight(GetTransactionWeight(*tx)), nUsageSize(RecursiveDynamicUsage(tx)), nTime(_nTime), entryHeight(_entryHeight),
-    spendsCoinbase(_spendsCoinbase), sigOpCost(_sigOpsCost), lockPoints(lp), m_epoch(0)
+    : tx(_tx), nFee(_nFee), nTime(_nTime), lockPoints(lp), nTxWeight(GetTransactionWeight(*tx)), nUsageSize(RecursiveDynamicUsage(tx)),
+    sigOpCost(_sigOpsCost), entryHeight(_entryHeight), spendsCoinbase(_spendsCoinbase), m_epoch(0)
 {
+    // sigOpCost is stored in 32 bits
+    assert(_sigOpsCost >= 0 && _sigOpsCost <= std::numeric_limits<int32_t>::max());
+
     nCountWithDescendants = 1;
     nSizeWithDescendants = GetTxSize();
     nModFeesWithDescendants = nFee;
@@ -59,13 +64,19 @@ size_t CTxMemPoolEntry::GetTxSize() const
 // descendants.
 void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude)
 {
-    setEntries stageEntries, setAllDescendants;
-    stageEntries = GetMemPoolChildren(updateIt);
+    const auto epoch = GetFreshEpoch();
+    std::vector<txiter>& stageEntries = m_epoch_stage;
+    std::vector<txiter> allDescendants;
+    stageEntries.clear();
+    visited(updateIt);
+    for (txiter childEntry : GetMemPoolChildren(updateIt)) {
+        if (!visited(childEntry)) stageEntries.push_back(childEntry);
+    }
 
     while (!stageEntries.empty()) {
-        const txiter cit = *stageEntries.begin();
-        setAllDescendants.insert(cit);
-        stageEntries.erase(cit);
+        const txiter cit = stageEntries.back();
+        stageEntries.pop_back();
+        allDescendants.push_back(cit);
         const setEntries &setChildren = GetMemPoolChildren(cit);
         for (txiter childEntry : setChildren) {
             cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
@@ -73,25 +84,26 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendan
                 // We've already calculated this one, just add the entries for this set
                 // but don't traverse again.
                 for (txiter cacheEntry : cacheIt->second) {
-                    setAllDescendants.insert(cacheEntry);
+                    if (!visited(cacheEntry)) allDescendants.push_back(cacheEntry);
                 }
-            } else if (!setAllDescendants.count(childEntry)) {
+            } else if (!visited(childEntry)) {
                 // Schedule for later processing
-                stageEntries.insert(childEntry);
+                stageEntries.push_back(childEntry);
             }
         }
     }
-    // setAllDescendants now contains all in-mempool descendants of updateIt.
+    // allDescendants now contains all in-mempool descendants of updateIt.
     // Update and add to cached descendant map
     int64_t modifySize = 0;
     CAmount modifyFee = 0;
     int64_t modifyCount = 0;
-    for (txiter cit : setAllDescendants) {
+    std::vector<txiter>& cached = cachedDescendants[updateIt];
+    for (txiter cit : allDescendants) {
         if (!setExclude.count(cit->GetTx().GetHash())) {
             modifySize += cit->GetTxSize();
             modifyFee += cit->GetModifiedFee();
             modifyCount++;
-            cachedDescendants[updateIt].insert(cit);
+            cached.push_back(cit);
             // Update ancestor state for each descendant
             mapTx.modify(cit, update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost()));
         }
@@ -151,7 +163,9 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
 
 bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents /* = true */) const
 {
-    setEntries parentHashes;
+    const auto epoch = GetFreshEpoch();
+    std::vector<txiter>& parentHashes = m_epoch_stage;
+    parentHashes.clear();
     const CTransaction &tx = entry.GetTx();
 
     if (fSearchForParents) {
@@ -160,8 +174,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // iterate mapTx to find parents.
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             Optional<txiter> piter = GetIter(tx.vin[i].prevout.hash);
-            if (piter) {
-                parentHashes.insert(*piter);
+            if (piter && !visited(*piter)) {
+                parentHashes.push_back(*piter);
                 if (parentHashes.size() + 1 > limitAncestorCount) {
                     errString = strprintf("too many unconfirmed parents [limit: %u]", limitAncestorCount);
                     return false;
@@ -172,16 +186,26 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // If we're not searching for parents, we require this to be an
         // entry in the mempool already.
         txiter it = mapTx.iterator_to(entry);
-        parentHashes = GetMemPoolParents(it);
+        visited(it);
+        for (txiter piter : GetMemPoolParents(it)) {
+            visited(piter);
+            parentHashes.push_back(piter);
+        }
+    }
+    // Entries already in setAncestors are not walked again.
+    for (txiter ancestor : setAncestors) {
+        visited(ancestor);
     }
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
 
+    // Every entry is pushed onto parentHashes at most once, so the number of
+    // ancestors found so far is the stage plus what has been popped off it.
     while (!parentHashes.empty()) {
-        txiter stageit = *parentHashes.begin();
+        txiter stageit = parentHashes.back();
 
         setAncestors.insert(stageit);
-        parentHashes.erase(stageit);
+        parentHashes.pop_back();
         totalSizeWithAncestors += stageit->GetTxSize();
 
         if (stageit->GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
@@ -198,8 +222,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         const setEntries & setMemPoolParents = GetMemPoolParents(stageit);
         for (txiter phash : setMemPoolParents) {
             // If this is a new ancestor, add it.
-            if (setAncestors.count(phash) == 0) {
-                parentHashes.insert(phash);
+            if (!visited(phash)) {
+                parentHashes.push_back(phash);
             }
             if (parentHashes.size() + setAncestors.size() + 1 > limitAncestorCount) {
                 errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
@@ -311,8 +335,8 @@ void CTxMemPoolEntry::UpdateDescendantState(int64_t modifySize, CAmount modifyFe
     nSizeWithDescendants += modifySize;
     assert(int64_t(nSizeWithDescendants) > 0);
     nModFeesWithDescendants += modifyFee;
+    assert(int64_t{nCountWithDescendants} + modifyCount > 0);
     nCountWithDescendants += modifyCount;
-    assert(int64_t(nCountWithDescendants) > 0);
 }
 
 void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount, int64_t modifySigOps)
@@ -320,8 +344,8 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
     nSizeWithAncestors += modifySize;
     assert(int64_t(nSizeWithAncestors) > 0);
     nModFeesWithAncestors += modifyFee;
+    assert(int64_t{nCountWithAncestors} + modifyCount > 0);
     nCountWithAncestors += modifyCount;
-    assert(int64_t(nCountWithAncestors) > 0);
     nSigOpCostWithAncestors += modifySigOps;
     assert(int(nSigOpCostWithAncestors) >= 0);
 }
@@ -405,13 +429,7 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
 
 void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 {
-    if (reason != MemPoolRemovalReason::BLOCK) {
-        // Notify clients that a transaction has been removed from the mempool
-        // for any reason except being included in a block. Clients interested
-        // in transactions included in blocks can subscribe to the BlockConnected
-        // notification.
-        GetMainSignals().TransactionRemovedFromMempool(it->GetSharedTx());
-    }
+    GetMainSignals().TransactionRemovedFromMempool(it->GetSharedTx(), reason, GetAndIncrementSequence());
 
     const uint256 hash = it->GetTx().GetHash();
     for (const CTxIn& txin : it->GetTx().vin)
@@ -443,22 +461,26 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 // can save time by not iterating over those entries.
 void CTxMemPool::CalculateDescendants(txiter entryit, setEntries& setDescendants) const
 {
-    setEntries stage;
-    if (setDescendants.count(entryit) == 0) {
-        stage.insert(entryit);
+    if (setDescendants.count(entryit)) {
+        return;
     }
+    const auto epoch = GetFreshEpoch();
+    std::vector<txiter>& stage = m_epoch_stage;
+    stage.clear();
+    visited(entryit);
+    stage.push_back(entryit);
     // Traverse down the children of entry, only adding children that are not
     // accounted for in setDescendants already (because those children have either
     // already been walked, or will be walked in this iteration).
     while (!stage.empty()) {
-        txiter it = *stage.begin();
+        txiter it = stage.back();
+        stage.pop_back();
         setDescendants.insert(it);
-        stage.erase(it);
 
         const setEntries &setChildren = GetMemPoolChildren(it);
         for (txiter childiter : setChildren) {
-            if (!setDescendants.count(childiter)) {
-                stage.insert(childiter);
+            if (!visited(childiter) && !setDescendants.count(childiter)) {
+                stage.push_back(childiter);
             }
         }
     }
@@ -1046,21 +1068,19 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
         CalculateDescendants(mapTx.project<0>(it), stage);
         nTxnRemoved += stage.size();
 
-        std::vector<CTransaction> txn;
-        if (pvNoSpendsRemaining) {
-            txn.reserve(stage.size());
-            for (txiter iter : stage)
-                txn.push_back(iter->GetTx());
-        }
-        RemoveStaged(stage, false, MemPoolRemovalReason::SIZELIMIT);
+        std::vector<COutPoint> prevouts;
         if (pvNoSpendsRemaining) {
-            for (const CTransaction& tx : txn) {
-                for (const CTxIn& txin : tx.vin) {
-                    if (exists(txin.prevout.hash)) continue;
-                    pvNoSpendsRemaining->push_back(txin.prevout);
+            for (txiter iter : stage) {
+                for (const CTxIn& txin : iter->GetTx().vin) {
+                    prevouts.push_back(txin.prevout);
                 }
             }
         }
+        RemoveStaged(stage, false, MemPoolRemovalReason::SIZELIMIT);
+        for (const COutPoint& prevout : prevouts) {
+            if (mapTx.count(prevout.hash)) continue;
+            pvNoSpendsRemaining->push_back(prevout);
+        }
     }
 
     if (maxFeeRateRemoved > CFeeRate(0)) {
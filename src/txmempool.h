@@ -29,7 +29,7 @@
 #include <boost/multi_index/sequenced_index.hpp>
 
 class CBlockIndex;
-extern RecursiveMutex cs_main;
+extern TimedRecursiveMutex cs_main;
 
 /** Fake height value used in Coin to signify they are only in the memory pool (since 0.8) */
 static const uint32_t MEMPOOL_HEIGHT = 0x7FFFFFFF;
@@ -64,30 +64,34 @@ struct LockPoints
 class CTxMemPoolEntry
 {
 private:
+    // Fields are grouped by width to keep padding to a minimum. Values
+    // that are bounded well below 2^32 (weight, usage, sigops, counts)
+    // are stored in 32 bits.
     const CTransactionRef tx;
     const CAmount nFee;             //!< Cached to avoid expensive parent-transaction lookups
-    const size_t nTxWeight;         //!< ... and avoid recomputing tx weight (also used for GetTxSize())
-    const size_t nUsageSize;        //!< ... and total memory usage
     const int64_t nTime;            //!< Local time when entering the mempool
-    const unsigned int entryHeight; //!< Chain height when entering the mempool
-    const bool spendsCoinbase;      //!< keep track of transactions that spend a coinbase
-    const int64_t sigOpCost;        //!< Total sigop cost
     int64_t feeDelta;          //!< Used for determining the priority of the transaction for mining in a block
     LockPoints lockPoints;     //!< Track the height and time at which tx was final
 
     // Information about descendants of this transaction that are in the
     // mempool; if we remove this transaction we must remove all of these
     // descendants as well.
-    uint64_t nCountWithDescendants;  //!< number of descendant transactions
-    uint64_t nSizeWithDescendants;   //!< ... and size
+    uint64_t nSizeWithDescendants;   //!< size of descendant transactions
     CAmount nModFeesWithDescendants; //!< ... and total fees (all including us)
 
     // Analogous statistics for ancestor transactions
-    uint64_t nCountWithAncestors;
     uint64_t nSizeWithAncestors;
     CAmount nModFeesWithAncestors;
     int64_t nSigOpCostWithAncestors;
 
+    const uint32_t nTxWeight;       //!< Cached to avoid recomputing tx weight (also used for GetTxSize())
+    const uint32_t nUsageSize;      //!< Cached total memory usage of the transaction
+    const int32_t sigOpCost;        //!< Total sigop cost
+    const unsigned int entryHeight; //!< Chain height when entering the mempool
+    uint32_t nCountWithDescendants; //!< number of descendant transactions
+    uint32_t nCountWithAncestors;   //!< number of ancestor transactions
+    const bool spendsCoinbase;      //!< keep track of transactions that spend a coinbase
+
 public:
     CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                     int64_t _nTime, unsigned int _entryHeight,
@@ -127,7 +131,7 @@ public:
     CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
     int64_t GetSigOpCostWithAncestors() const { return nSigOpCostWithAncestors; }
 
-    mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
+    mutable uint32_t vTxHashesIdx; //!< Index in mempool's vTxHashes
     mutable uint64_t m_epoch; //!< epoch when last touched, useful for graph algorithms
 };
 
@@ -242,18 +246,18 @@ public:
 
 /** \class CompareTxMemPoolEntryByScore
  *
- *  Sort by feerate of entry (fee/size) in descending order
- *  This is only used for transaction relay, so we use GetFee()
- *  instead of GetModifiedFee() to avoid leaking prioritization
- *  information via the sort order.
+ *  Sort by modified feerate of entry (modified fee/size) in descending order
+ *  This is used for transaction relay, which announces transactions in the
+ *  order they would be mined in. Note that this makes prioritization
+ *  visible to peers through the announcement order.
  */
 class CompareTxMemPoolEntryByScore
 {
 public:
     bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
     {
-        double f1 = (double)a.GetFee() * b.GetTxSize();
-        double f2 = (double)b.GetFee() * a.GetTxSize();
+        double f1 = (double)a.GetModifiedFee() * b.GetTxSize();
+        double f2 = (double)b.GetModifiedFee() * a.GetTxSize();
         if (f1 == f2) {
             return b.GetTx().GetHash() < a.GetTx().GetHash();
         }
@@ -534,7 +538,13 @@ public:
     const setEntries & GetMemPoolChildren(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
     uint64_t CalculateDescendantMaximum(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
 private:
-    typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
+    typedef std::map<txiter, std::vector<txiter>, CompareIteratorByHash> cacheMap;
+
+    //! Scratch stack for epoch-based traversals, reused to avoid reallocating on every walk.
+    mutable std::vector<txiter> m_epoch_stage GUARDED_BY(cs);
+
+    //! Sequence number handed to the next mempool addition or removal notification
+    mutable uint64_t m_sequence_number GUARDED_BY(cs){1};
 
     struct TxLinks {
         setEntries parents;
@@ -686,6 +696,22 @@ public:
         return totalTxSize;
     }
 
+    /**
+     * Every transaction entering or leaving the pool takes the next sequence
+     * number, which is passed along with its validation interface
+     * notification. A snapshot of the pool taken together with
+     * GetSequence() reflects exactly the events numbered below it.
+     */
+    uint64_t GetAndIncrementSequence() const EXCLUSIVE_LOCKS_REQUIRED(cs)
+    {
+        return m_sequence_number++;
+    }
+
+    uint64_t GetSequence() const EXCLUSIVE_LOCKS_REQUIRED(cs)
+    {
+        return m_sequence_number;
+    }
+
     bool exists(const uint256& hash) const
     {
         LOCK(cs);
@@ -15,6 +15,7 @@
 #include <consensus/tx_check.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <crypto/hmac_sha256.h>
 #include <cuckoocache.h>
 #include <flatfile.h>
 #include <hash.h>
@@ -50,7 +51,10 @@
 #include <wallet/wallet.h>
 #include <key.h>
 
+#include <condition_variable>
+#include <list>
 #include <string>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -106,13 +110,14 @@ CChain& ChainActive() {
  * The transaction pool has a separate lock to allow reading from it and the
  * chainstate at the same time.
  */
-RecursiveMutex cs_main;
+TimedRecursiveMutex cs_main;
 
 CBlockIndex *pindexBestHeader = nullptr;
 Mutex g_best_block_mutex;
 std::condition_variable g_best_block_cv;
 uint256 g_best_block;
 bool g_parallel_script_checks{false};
+int g_script_check_threads{0};
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fHavePruned = false;
@@ -188,6 +193,104 @@ static FILE* OpenUndoFile(const FlatFilePos &pos, bool fReadOnly = false);
 static FlatFileSeq BlockFileSeq();
 static FlatFileSeq UndoFileSeq();
 
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+
+namespace {
+
+/** Number of recently connected blocks whose block and undo data are kept in memory. */
+static const size_t RECENT_UNDO_CACHE_SIZE = 10;
+
+/**
+ * Small LRU of the most recently connected blocks and their undo data.
+ *
+ * Short reorgs are common on PoS chains; disconnecting a block that was
+ * connected moments ago should not have to read it and its undo data back
+ * from disk. Entries are keyed by block index and hold exactly the data
+ * written to disk, so a hit is always interchangeable with a disk read.
+ */
+class RecentUndoCache
+{
+private:
+    struct Entry {
+        const CBlockIndex* pindex;
+        std::shared_ptr<const CBlock> block;
+        std::shared_ptr<const CBlockUndo> undo;
+        Entry(const CBlockIndex* pindex_in, std::shared_ptr<const CBlockUndo> undo_in) : pindex(pindex_in), undo(std::move(undo_in)) {}
+    };
+
+    mutable Mutex m_mutex;
+    //! Most recently used entry at the front.
+    std::list<Entry> m_entries GUARDED_BY(m_mutex);
+
+    std::list<Entry>::iterator Find(const CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(m_mutex)
+    {
+        for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+            if (it->pindex == pindex) {
+                m_entries.splice(m_entries.begin(), m_entries, it);
+                return m_entries.begin();
+            }
+        }
+        return m_entries.end();
+    }
+
+public:
+    void AddUndo(const CBlockIndex* pindex, std::shared_ptr<const CBlockUndo> undo)
+    {
+        LOCK(m_mutex);
+        auto it = Find(pindex);
+        if (it != m_entries.end()) {
+            it->undo = std::move(undo);
+            return;
+        }
+        m_entries.emplace_front(pindex, std::move(undo));
+        if (m_entries.size() > RECENT_UNDO_CACHE_SIZE) m_entries.pop_back();
+    }
+
+    void AddBlock(const CBlockIndex* pindex, std::shared_ptr<const CBlock> block)
+    {
+        LOCK(m_mutex);
+        auto it = Find(pindex);
+        if (it != m_entries.end()) it->block = std::move(block);
+    }
+
+    std::shared_ptr<const CBlock> GetBlock(const CBlockIndex* pindex)
+    {
+        LOCK(m_mutex);
+        auto it = Find(pindex);
+        return it != m_entries.end() ? it->block : nullptr;
+    }
+
+    std::shared_ptr<const CBlockUndo> GetUndo(const CBlockIndex* pindex)
+    {
+        LOCK(m_mutex);
+        auto it = Find(pindex);
+        return it != m_entries.end() ? it->undo : nullptr;
+    }
+
+    void Erase(const CBlockIndex* pindex)
+    {
+        LOCK(m_mutex);
+        auto it = Find(pindex);
+        if (it != m_entries.end()) m_entries.erase(it);
+    }
+
+    void Clear()
+    {
+        LOCK(m_mutex);
+        m_entries.clear();
+    }
+};
+
+RecentUndoCache g_recent_undo;
+
+} // namespace
+
+/** The undo data g_recent_undo holds for a block, or nullptr if it is not cached. Exposed for unit tests. */
+std::shared_ptr<const CBlockUndo> GetCachedBlockUndo(const CBlockIndex* pindex)
+{
+    return g_recent_undo.GetUndo(pindex);
+}
+
 bool CheckFinalTx(const CTransaction &tx, int flags)
 {
     AssertLockHeld(cs_main);
@@ -313,16 +416,17 @@ bool CheckSequenceLocks(const CTxMemPool& pool, const CTransaction& tx, int flag
 // Returns the script flags which should be checked for a given block
 static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consensus::Params& chainparams);
 
-static void LimitMempoolSize(CTxMemPool& pool, size_t limit, std::chrono::seconds age)
-    EXCLUSIVE_LOCKS_REQUIRED(pool.cs, ::cs_main)
+void LimitMempoolSize(CTxMemPool& pool, size_t limit, std::chrono::seconds age)
 {
     int expired = pool.Expire(GetTime<std::chrono::seconds>() - age);
     if (expired != 0) {
         LogPrint(BCLog::MEMPOOL, "Expired %i transactions from the memory pool\n", expired);
     }
 
+    if (pool.DynamicMemoryUsage() <= limit) return;
+
     std::vector<COutPoint> vNoSpendsRemaining;
-    pool.TrimToSize(limit, &vNoSpendsRemaining);
+    pool.TrimToSize(limit / 100 * MEMPOOL_TRIM_LOW_WATER_PERCENT, &vNoSpendsRemaining);
     for (const COutPoint& removed : vNoSpendsRemaining)
         ::ChainstateActive().CoinsTip().Uncache(removed);
 }
@@ -491,6 +595,13 @@ private:
     // only invoke this on transactions that have otherwise passed policy checks.
     bool PolicyScriptChecks(ATMPArgs& args, Workspace& ws, PrecomputedTransactionData& txdata) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    // Run the per-input checks of PolicyScriptChecks() on the script check
+    // threads. Only reports success: on failure the caller re-runs the checks
+    // inline to determine the rejection reason. Signatures verified here are
+    // stored in the signature cache, so that re-run is cheap up to the first
+    // failing input.
+    bool PolicyScriptChecksParallel(const CTransaction& tx, const CCoinsViewCache& view, unsigned int flags, PrecomputedTransactionData& txdata) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
     // Re-run the script checks, using consensus flags, and try to cache the
     // result in the scriptcache. This should be done after
     // PolicyScriptChecks(). This requires that all inputs either be in our
@@ -918,6 +1029,19 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
     return true;
 }
 
+bool MemPoolAccept::PolicyScriptChecksParallel(const CTransaction& tx, const CCoinsViewCache& view, unsigned int flags, PrecomputedTransactionData& txdata)
+{
+    std::vector<CScriptCheck> vChecks;
+    TxValidationState state_dummy; // Never filled in when pvChecks is passed
+    if (!CheckInputScripts(tx, state_dummy, view, flags, true, false, txdata, &vChecks)) {
+        return false;
+    }
+
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    control.Add(vChecks);
+    return control.Wait();
+}
+
 bool MemPoolAccept::PolicyScriptChecks(ATMPArgs& args, Workspace& ws, PrecomputedTransactionData& txdata)
 {
     const CTransaction& tx = *ws.m_ptx;
@@ -928,6 +1052,9 @@ bool MemPoolAccept::PolicyScriptChecks(ATMPArgs& args, Workspace& ws, Precompute
 
     // Check input scripts and signatures.
     // This is done last to help prevent CPU exhaustion denial-of-service attacks.
+    if (g_parallel_script_checks && tx.vin.size() > 1 && PolicyScriptChecksParallel(tx, m_view, scriptVerifyFlags, txdata)) {
+        return true;
+    }
     if (!CheckInputScripts(tx, state, m_view, scriptVerifyFlags, true, false, txdata)) {
         // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
         // need to turn both off, and compare against just turning off CLEANSTACK
@@ -1048,7 +1175,7 @@ bool MemPoolAccept::AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs
 
     if (!Finalize(args, workspace)) return false;
 
-    GetMainSignals().TransactionAddedToMempool(ptx);
+    GetMainSignals().TransactionAddedToMempool(ptx, m_pool.GetAndIncrementSequence());
 
     return true;
 }
@@ -1560,6 +1687,158 @@ void InitScriptExecutionCache() {
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+static const uint64_t SCRIPT_CACHES_DUMP_VERSION = 2;
+
+/**
+ * sigcache.dat is authenticated with HMAC-SHA256 under a key that is kept in
+ * sigcache.key rather than in the dump itself, and replaced on every dump. A
+ * cache file that was not written by this node (or was modified since) fails
+ * verification and is ignored, so its entries can never be used to skip
+ * script checks.
+ */
+static const size_t SCRIPT_CACHES_KEY_SIZE = 32;
+
+static bool ReadScriptCachesKey(std::vector<unsigned char>& key)
+{
+    FILE* filestr = fsbridge::fopen(GetDataDir() / "sigcache.key", "rb");
+    if (!filestr) {
+        return false;
+    }
+    key.resize(SCRIPT_CACHES_KEY_SIZE);
+    const bool ok = fread(key.data(), 1, key.size(), filestr) == key.size() && fgetc(filestr) == EOF;
+    fclose(filestr);
+    return ok;
+}
+
+static bool WriteScriptCachesKey(const std::vector<unsigned char>& key)
+{
+    FILE* filestr = fsbridge::fopen(GetDataDir() / "sigcache.key.new", "wb");
+    if (!filestr) {
+        return false;
+    }
+    const bool ok = fwrite(key.data(), 1, key.size(), filestr) == key.size() && FileCommit(filestr);
+    fclose(filestr);
+    return ok && RenameOver(GetDataDir() / "sigcache.key.new", GetDataDir() / "sigcache.key");
+}
+
+static uint256 ScriptCachesMAC(const std::vector<unsigned char>& key, uint64_t version, const std::vector<unsigned char>& payload)
+{
+    CDataStream header(SER_DISK, CLIENT_VERSION);
+    header << version;
+    uint256 mac;
+    CHMAC_SHA256(key.data(), key.size())
+        .Write((const unsigned char*)header.data(), header.size())
+        .Write(payload.data(), payload.size())
+        .Finalize(mac.begin());
+    return mac;
+}
+
+bool LoadScriptCaches()
+{
+    FILE* filestr = fsbridge::fopen(GetDataDir() / "sigcache.dat", "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open signature cache file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    std::vector<unsigned char> key;
+    if (!ReadScriptCachesKey(key)) {
+        LogPrintf("Failed to read signature cache key from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    uint256 sig_nonce, script_nonce;
+    std::vector<uint256> sig_entries, script_entries;
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != SCRIPT_CACHES_DUMP_VERSION) {
+            return false;
+        }
+        std::vector<unsigned char> payload;
+        uint256 mac;
+        file >> payload >> mac;
+        if (mac != ScriptCachesMAC(key, version, payload)) {
+            LogPrintf("Signature cache file failed authentication. Continuing anyway.\n");
+            return false;
+        }
+
+        VectorReader reader(SER_DISK, CLIENT_VERSION, payload, 0);
+        // Entries are only known-valid under the script rules of the version
+        // that produced them, so never reuse a dump written by another client.
+        int client_version;
+        reader >> client_version;
+        if (client_version != CLIENT_VERSION) {
+            LogPrintf("Ignoring signature cache written by client version %d\n", client_version);
+            return false;
+        }
+        reader >> sig_nonce >> sig_entries;
+        reader >> script_nonce >> script_entries;
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize signature cache data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    SetSignatureCacheState(sig_nonce, sig_entries);
+    {
+        LOCK(cs_main);
+        scriptExecutionCacheNonce = script_nonce;
+        for (const uint256& entry : script_entries) {
+            scriptExecutionCache.insert(entry);
+        }
+    }
+
+    LogPrintf("Imported signature cache from disk: %u signature entries, %u script execution entries\n", sig_entries.size(), script_entries.size());
+    return true;
+}
+
+bool DumpScriptCaches()
+{
+    int64_t start = GetTimeMicros();
+
+    uint256 sig_nonce, script_nonce;
+    std::vector<uint256> sig_entries, script_entries;
+    GetSignatureCacheState(sig_nonce, sig_entries);
+    {
+        LOCK(cs_main);
+        script_nonce = scriptExecutionCacheNonce;
+        scriptExecutionCache.for_each_live([&script_entries](const uint256& entry) { script_entries.push_back(entry); });
+    }
+
+    int64_t mid = GetTimeMicros();
+
+    try {
+        std::vector<unsigned char> payload;
+        CVectorWriter(SER_DISK, CLIENT_VERSION, payload, 0) << CLIENT_VERSION << sig_nonce << sig_entries << script_nonce << script_entries;
+
+        std::vector<unsigned char> key(SCRIPT_CACHES_KEY_SIZE);
+        GetStrongRandBytes(key.data(), key.size());
+        if (!WriteScriptCachesKey(key))
+            throw std::runtime_error("failed to write sigcache.key");
+
+        FILE* filestr = fsbridge::fopen(GetDataDir() / "sigcache.dat.new", "wb");
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        uint64_t version = SCRIPT_CACHES_DUMP_VERSION;
+        file << version << payload << ScriptCachesMAC(key, version, payload);
+
+        if (!FileCommit(file.Get()))
+            throw std::runtime_error("FileCommit failed");
+        file.fclose();
+        RenameOver(GetDataDir() / "sigcache.dat.new", GetDataDir() / "sigcache.dat");
+        int64_t last = GetTimeMicros();
+        LogPrintf("Dumped signature cache: %gs to copy, %gs to dump\n", (mid-start)*MICRO, (last-mid)*MICRO);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump signature cache: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
 /**
  * Check whether all of this transaction's input scripts succeed.
  *
@@ -1769,15 +2048,24 @@ int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
 
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  When FAILED is returned, view is left in an indeterminate state. */
-DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view)
+DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view, const CBlockUndo* undo)
 {
     bool fClean = true;
 
-    CBlockUndo blockUndo;
-    if (!UndoReadFromDisk(blockUndo, pindex)) {
-        error("DisconnectBlock(): failure reading undo data");
-        return DISCONNECT_FAILED;
+    std::shared_ptr<const CBlockUndo> pundo;
+    if (!undo) {
+        pundo = g_recent_undo.GetUndo(pindex);
+        if (!pundo) {
+            std::shared_ptr<CBlockUndo> pundoNew = std::make_shared<CBlockUndo>();
+            if (!UndoReadFromDisk(*pundoNew, pindex)) {
+                error("DisconnectBlock(): failure reading undo data");
+                return DISCONNECT_FAILED;
+            }
+            pundo = pundoNew;
+        }
+        undo = pundo.get();
     }
+    const CBlockUndo& blockUndo = *undo;
 
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size()) {
         error("DisconnectBlock(): block and undo data inconsistent");
@@ -1806,18 +2094,18 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
 
         // restore inputs
         if (i > 0) { // not coinbases
-            CTxUndo &txundo = blockUndo.vtxundo[i-1];
+            const CTxUndo &txundo = blockUndo.vtxundo[i-1];
             if (txundo.vprevout.size() != tx.vin.size()) {
                 error("DisconnectBlock(): transaction and undo data inconsistent");
                 return DISCONNECT_FAILED;
             }
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
                 const COutPoint &out = tx.vin[j].prevout;
-                int res = ApplyTxInUndo(std::move(txundo.vprevout[j]), view, out);
+                // Undo data may be shared with the recent undo cache, so restore from a copy.
+                int res = ApplyTxInUndo(Coin(txundo.vprevout[j]), view, out);
                 if (res == DISCONNECT_FAILED) return DISCONNECT_FAILED;
                 fClean = fClean && res != DISCONNECT_UNCLEAN;
             }
-            // At this point, all of txundo.vprevout should have been moved out.
         }
     }
 
@@ -1864,8 +2152,6 @@ static bool WriteUndoDataForBlock(const CBlockUndo& blockundo, BlockValidationSt
     return true;
 }
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
-
 void ThreadScriptCheck(int worker_num) {
     util::ThreadRename(strprintf("scriptch.%i", worker_num));
     scriptcheckqueue.Thread();
@@ -1982,27 +2268,36 @@ static int64_t nTimeTotal = 0;
 static int64_t nBlocksTotal = 0;
 
 bool GetSpentCoinFromBlock(const CBlockIndex* pindex, COutPoint prevout, Coin* coin) {
-    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-    CBlock& block = *pblock;
-    if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
-        return error("GetSpentCoinFromBlock(): Could not read block from disk");
+    std::shared_ptr<const CBlock> pblock = g_recent_undo.GetBlock(pindex);
+    if (!pblock) {
+        std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
+        if (!ReadBlockFromDisk(*pblockNew, pindex, Params().GetConsensus())) {
+            return error("GetSpentCoinFromBlock(): Could not read block from disk");
+        }
+        pblock = pblockNew;
     }
+    const CBlock& block = *pblock;
 
     for(size_t j = 1; j < block.vtx.size(); ++j) {
-        CTransactionRef& tx = block.vtx[j];
+        const CTransactionRef& tx = block.vtx[j];
         for(size_t k = 0; k < tx->vin.size(); ++k) {
             const COutPoint& tmpprevout = tx->vin[k].prevout;
             if(tmpprevout == prevout) {
-                CBlockUndo undo;
-                if(!UndoReadFromDisk(undo, pindex)) {
-                    return error("GetSpentCoinFromBlock(): Could not read undo block from disk");
+                std::shared_ptr<const CBlockUndo> pundo = g_recent_undo.GetUndo(pindex);
+                if (!pundo) {
+                    std::shared_ptr<CBlockUndo> pundoNew = std::make_shared<CBlockUndo>();
+                    if(!UndoReadFromDisk(*pundoNew, pindex)) {
+                        return error("GetSpentCoinFromBlock(): Could not read undo block from disk");
+                    }
+                    pundo = pundoNew;
                 }
+                const CBlockUndo& undo = *pundo;
 
                 if(undo.vtxundo.size() != block.vtx.size() - 1) {
                     return error("GetSpentCoinFromBlock(): undo tx size not equal to block tx size");
                 }
 
-                CTxUndo &txundo = undo.vtxundo[j-1]; // no vtxundo for coinbase
+                const CTxUndo &txundo = undo.vtxundo[j-1]; // no vtxundo for coinbase
 
                 if(txundo.vprevout.size() != tx->vin.size()) {
                     return error("GetSpentCoinFromBlock(): undo tx vin size not equal to block tx vin size");
@@ -2444,6 +2739,7 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
 
     if (!WriteUndoDataForBlock(blockundo, state, pindex, chainparams))
         return false;
+    g_recent_undo.AddUndo(pindex, std::make_shared<const CBlockUndo>(std::move(blockundo)));
 
     if (!pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
         pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
@@ -2737,11 +3033,15 @@ bool CChainState::DisconnectTip(BlockValidationState& state, const CChainParams&
 {
     CBlockIndex *pindexDelete = m_chain.Tip();
     assert(pindexDelete);
-    // Read block from disk.
-    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-    CBlock& block = *pblock;
-    if (!ReadBlockFromDisk(block, pindexDelete, chainparams.GetConsensus()))
-        return error("DisconnectTip(): Failed to read block");
+    // Read block from disk, unless it was connected recently enough to still be cached.
+    std::shared_ptr<const CBlock> pblock = g_recent_undo.GetBlock(pindexDelete);
+    if (!pblock) {
+        std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
+        if (!ReadBlockFromDisk(*pblockNew, pindexDelete, chainparams.GetConsensus()))
+            return error("DisconnectTip(): Failed to read block");
+        pblock = pblockNew;
+    }
+    const CBlock& block = *pblock;
 
     LogPrint(BCLog::COINSTAKE, "%s: disconnecting block %s\n", __func__, block.GetHash().ToString());
 
@@ -2774,6 +3074,7 @@ bool CChainState::DisconnectTip(BlockValidationState& state, const CChainParams&
     }
 
     m_chain.SetTip(pindexDelete->pprev);
+    g_recent_undo.Erase(pindexDelete);
 
     UpdateTip(pindexDelete->pprev, chainparams);
     // Let wallets know transactions went from 1-confirmed to
@@ -2886,6 +3187,7 @@ bool CChainState::ConnectTip(BlockValidationState& state, const CChainParams& ch
     LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime5) * MILLI, nTimePostConnect * MICRO, nTimePostConnect * MILLI / nBlocksTotal);
     LogPrint(BCLog::BENCH, "- Connect block: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime1) * MILLI, nTimeTotal * MICRO, nTimeTotal * MILLI / nBlocksTotal);
 
+    g_recent_undo.AddBlock(pindexNew, pthisBlock);
     connectTrace.BlockConnected(pindexNew, std::move(pthisBlock));
     return true;
 }
@@ -4853,25 +5155,215 @@ CVerifyDB::~CVerifyDB()
     uiInterface.ShowProgress("", 100, false);
 }
 
+namespace {
+/** Number of blocks CVerifyDB::VerifyDB() reads ahead of the block it is checking */
+static constexpr size_t VERIFYDB_READAHEAD_BLOCKS = 16;
+
+/**
+ * Reads blocks and undo data and runs the context-free CheckBlock() for
+ * CVerifyDB::VerifyDB() on a pool of threads, so that levels 0-2 overlap
+ * with each other and with the serial disconnect and reconnect levels.
+ * Blocks are queued by the consumer in the order it needs them, and at most
+ * `window` of them are queued or held at a time, which bounds the memory
+ * used by read-ahead blocks regardless of the check depth. Without worker
+ * threads, each block is read by the consumer when it takes it.
+ */
+class VerifyDBPrefetcher
+{
+public:
+    struct Item {
+        CBlockIndex* pindex{nullptr};
+        FlatFilePos block_pos;
+        //! Only read the block, for reconnecting it at check level 4
+        bool read_only{false};
+        CBlock block;
+        //! Undo data read at check level 2, for disconnecting the block at level 3
+        std::shared_ptr<const CBlockUndo> undo;
+        bool done{false};
+        //! Set to the error to report if levels 0-2 failed for this block
+        std::string error;
+    };
+
+    VerifyDBPrefetcher(int check_level, const Consensus::Params& params, int threads, size_t window)
+        : m_check_level(check_level), m_params(params), m_slots(window)
+    {
+        for (int i = 0; i < threads; ++i) {
+            m_threads.emplace_back([this, i] {
+                util::ThreadRename(strprintf("verifydb.%i", i));
+                Run();
+            });
+        }
+    }
+
+    ~VerifyDBPrefetcher()
+    {
+        {
+            LOCK(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        for (std::thread& t : m_threads) t.join();
+    }
+
+    bool Full()
+    {
+        LOCK(m_mutex);
+        return m_added - m_taken == m_slots.size();
+    }
+
+    /** Queue a block to be read. Must not be called while Full(). */
+    void Add(CBlockIndex* pindex, const FlatFilePos& block_pos, bool read_only)
+    {
+        {
+            LOCK(m_mutex);
+            assert(m_added - m_taken < m_slots.size());
+            Item& item = m_slots[m_added % m_slots.size()];
+            item = Item{};
+            item.pindex = pindex;
+            item.block_pos = block_pos;
+            item.read_only = read_only;
+            ++m_added;
+        }
+        m_cv.notify_all();
+    }
+
+    /** Wait for the oldest queued block to be processed and hand it out. */
+    Item Take()
+    {
+        WAIT_LOCK(m_mutex, lock);
+        assert(m_taken < m_added);
+        Item& item = m_slots[m_taken % m_slots.size()];
+        if (m_next == m_taken) {
+            // Not claimed by a worker yet, or there are none: process it here
+            ++m_next;
+            REVERSE_LOCK(lock);
+            Process(item);
+        } else {
+            while (!item.done) m_cv.wait(lock);
+        }
+        ++m_taken;
+        return std::move(item);
+    }
+
+private:
+    const int m_check_level;
+    const Consensus::Params& m_params;
+    std::vector<std::thread> m_threads;
+
+    Mutex m_mutex;
+    std::condition_variable m_cv;
+    //! Ring buffer of queued items; slot n % size holds the n-th added item
+    std::vector<Item> m_slots GUARDED_BY(m_mutex);
+    size_t m_added GUARDED_BY(m_mutex){0};
+    size_t m_next GUARDED_BY(m_mutex){0};
+    size_t m_taken GUARDED_BY(m_mutex){0};
+    bool m_stop GUARDED_BY(m_mutex){false};
+
+    void Run()
+    {
+        while (true) {
+            Item* item;
+            {
+                WAIT_LOCK(m_mutex, lock);
+                while (!m_stop && m_next >= m_added) m_cv.wait(lock);
+                if (m_stop) return;
+                // The slot cannot be reused before Take() returned this item
+                item = &m_slots[m_next++ % m_slots.size()];
+            }
+            Process(*item);
+            {
+                LOCK(m_mutex);
+                item->done = true;
+            }
+            m_cv.notify_all();
+        }
+    }
+
+    void Process(Item& item)
+    {
+        const CBlockIndex* pindex = item.pindex;
+        // check level 0: read from disk
+        if (!ReadBlockFromDisk(item.block, item.block_pos, m_params) || item.block.GetHash() != pindex->GetBlockHash()) {
+            item.error = strprintf("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+            return;
+        }
+        if (item.read_only) return;
+        // check level 1: verify block validity
+        BlockValidationState state;
+        if (m_check_level >= 1 && !CheckBlock(item.block, state, m_params, false)) {
+            item.error = strprintf("VerifyDB: *** found bad block at %d, hash=%s (%s)\n",
+                                   pindex->nHeight, pindex->GetBlockHash().ToString(), state.ToString());
+            return;
+        }
+        // check level 2: verify undo validity
+        if (m_check_level >= 2 && !pindex->GetUndoPos().IsNull()) {
+            std::shared_ptr<CBlockUndo> undo = std::make_shared<CBlockUndo>();
+            if (!UndoReadFromDisk(*undo, pindex)) {
+                item.error = strprintf("VerifyDB(): *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+                return;
+            }
+            item.undo = std::move(undo);
+        }
+    }
+};
+} // namespace
+
 bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth)
 {
     LOCK(cs_main);
     if (::ChainActive().Tip() == nullptr || ::ChainActive().Tip()->pprev == nullptr)
         return true;
 
+    int64_t nStart = GetTimeMicros();
+
     // Verify blocks in the best chain
     if (nCheckDepth <= 0 || nCheckDepth > ::ChainActive().Height())
         nCheckDepth = ::ChainActive().Height();
     nCheckLevel = std::max(0, std::min(4, nCheckLevel));
-    LogPrintf("Verifying last %i blocks at level %i\n", nCheckDepth, nCheckLevel);
-    CCoinsViewCache coins(coinsview);
+
+    // Find where the checks stop, from the tip backwards
     CBlockIndex* pindex;
+    for (pindex = ::ChainActive().Tip(); pindex && pindex->pprev; pindex = pindex->pprev) {
+        if (pindex->nHeight <= ::ChainActive().Height()-nCheckDepth)
+            break;
+        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            // If pruning, only go back as far as we have data.
+            LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
+            break;
+        }
+    }
+    CBlockIndex* const pindexFirstUnchecked = pindex;
+
+    const int threads = g_script_check_threads;
+    LogPrintf("Verifying last %i blocks at level %i using %i additional threads\n", nCheckDepth, nCheckLevel, threads);
+    VerifyDBPrefetcher prefetcher(nCheckLevel, chainparams.GetConsensus(), threads, VERIFYDB_READAHEAD_BLOCKS);
+
+    // Keep the prefetcher fed in the order blocks are used: from the tip down
+    // to pindexFirstUnchecked for levels 0-3, then back up for level 4. Block
+    // positions are looked up here, under cs_main, for the read-ahead threads.
+    CBlockIndex* pindexNextDisconnect = ::ChainActive().Tip();
+    CBlockIndex* pindexNextConnect = pindexFirstUnchecked;
+    const auto queue_reads = [&]() EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+        while (!prefetcher.Full()) {
+            if (pindexNextDisconnect != pindexFirstUnchecked) {
+                prefetcher.Add(pindexNextDisconnect, pindexNextDisconnect->GetBlockPos(), /* read_only */ false);
+                pindexNextDisconnect = pindexNextDisconnect->pprev;
+            } else if (nCheckLevel >= 4 && pindexNextConnect != ::ChainActive().Tip()) {
+                pindexNextConnect = ::ChainActive().Next(pindexNextConnect);
+                prefetcher.Add(pindexNextConnect, pindexNextConnect->GetBlockPos(), /* read_only */ true);
+            } else {
+                break;
+            }
+        }
+    };
+
+    CCoinsViewCache coins(coinsview);
     CBlockIndex* pindexFailure = nullptr;
     int nGoodTransactions = 0;
     BlockValidationState state;
     int reportDone = 0;
     LogPrintf("[0%%]..."); /* Continued */
-    for (pindex = ::ChainActive().Tip(); pindex && pindex->pprev; pindex = pindex->pprev) {
+    for (pindex = ::ChainActive().Tip(); pindex != pindexFirstUnchecked; pindex = pindex->pprev) {
         boost::this_thread::interruption_point();
         const int percentageDone = std::max(1, std::min(99, (int)(((double)(::ChainActive().Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100))));
         if (reportDone < percentageDone/10) {
@@ -4880,34 +5372,16 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
             reportDone = percentageDone/10;
         }
         uiInterface.ShowProgress(_("Verifying blocks...").translated, percentageDone, false);
-        if (pindex->nHeight <= ::ChainActive().Height()-nCheckDepth)
-            break;
-        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
-            // If pruning, only go back as far as we have data.
-            LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
-            break;
-        }
-        CBlock block;
-        // check level 0: read from disk
-        if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
-            return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-        // check level 1: verify block validity
-        if (nCheckLevel >= 1 && !CheckBlock(block, state, chainparams.GetConsensus(), false))
-            return error("%s: *** found bad block at %d, hash=%s (%s)\n", __func__,
-                         pindex->nHeight, pindex->GetBlockHash().ToString(), state.ToString());
-        // check level 2: verify undo validity
-        if (nCheckLevel >= 2 && pindex) {
-            CBlockUndo undo;
-            if (!pindex->GetUndoPos().IsNull()) {
-                if (!UndoReadFromDisk(undo, pindex)) {
-                    return error("VerifyDB(): *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
-                }
-            }
-        }
+        // check levels 0-2 are run ahead by the prefetcher
+        queue_reads();
+        VerifyDBPrefetcher::Item item = prefetcher.Take();
+        assert(item.pindex == pindex);
+        if (!item.error.empty())
+            return error("%s", item.error);
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
         if (nCheckLevel >= 3 && (coins.DynamicMemoryUsage() + ::ChainstateActive().CoinsTip().DynamicMemoryUsage()) <= nCoinCacheUsage) {
             assert(coins.GetBestBlock() == pindex->GetBlockHash());
-            DisconnectResult res = ::ChainstateActive().DisconnectBlock(block, pindex, coins);
+            DisconnectResult res = ::ChainstateActive().DisconnectBlock(item.block, pindex, coins, item.undo.get());
             if (res == DISCONNECT_FAILED) {
                 return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
             }
@@ -4915,7 +5389,7 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
                 nGoodTransactions = 0;
                 pindexFailure = pindex;
             } else {
-                nGoodTransactions += block.vtx.size();
+                nGoodTransactions += item.block.vtx.size();
             }
         }
         if (ShutdownRequested())
@@ -4926,8 +5400,9 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
 
     // store block count as we move pindex at check level >= 4
     int block_count = ::ChainActive().Height() - pindex->nHeight;
+    int64_t nDisconnected = GetTimeMicros();
 
-    // check level 4: try reconnecting blocks
+    // check level 4: try reconnecting blocks, read ahead by the prefetcher
     if (nCheckLevel >= 4) {
         while (pindex != ::ChainActive().Tip()) {
             boost::this_thread::interruption_point();
@@ -4939,16 +5414,21 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
             }
             uiInterface.ShowProgress(_("Verifying blocks...").translated, percentageDone, false);
             pindex = ::ChainActive().Next(pindex);
-            CBlock block;
-            if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
-                return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-            if (!::ChainstateActive().ConnectBlock(block, state, pindex, coins, chainparams))
+            queue_reads();
+            VerifyDBPrefetcher::Item item = prefetcher.Take();
+            assert(item.pindex == pindex);
+            if (!item.error.empty())
+                return error("%s", item.error);
+            if (!::ChainstateActive().ConnectBlock(item.block, state, pindex, coins, chainparams))
                 return error("VerifyDB(): *** found unconnectable block at %d, hash=%s (%s)", pindex->nHeight, pindex->GetBlockHash().ToString(), state.ToString());
         }
     }
 
+    int64_t nEnd = GetTimeMicros();
     LogPrintf("[DONE].\n");
     LogPrintf("No coin database inconsistencies in last %i blocks (%i transactions)\n", block_count, nGoodTransactions);
+    LogPrintf("Verified %i blocks in %.2fs (levels 0-3: %.2fs, level 4: %.2fs)\n", block_count,
+              (nEnd - nStart) * MICRO, (nDisconnected - nStart) * MICRO, (nEnd - nDisconnected) * MICRO);
 
     return true;
 }
@@ -5009,10 +5489,15 @@ bool CChainState::ReplayBlocks(const CChainParams& params)
     // Rollback along the old branch.
     while (pindexOld != pindexFork) {
         if (pindexOld->nHeight > 0) { // Never disconnect the genesis block.
-            CBlock block;
-            if (!ReadBlockFromDisk(block, pindexOld, params.GetConsensus())) {
-                return error("RollbackBlock(): ReadBlockFromDisk() failed at %d, hash=%s", pindexOld->nHeight, pindexOld->GetBlockHash().ToString());
+            std::shared_ptr<const CBlock> pblock = g_recent_undo.GetBlock(pindexOld);
+            if (!pblock) {
+                std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
+                if (!ReadBlockFromDisk(*pblockNew, pindexOld, params.GetConsensus())) {
+                    return error("RollbackBlock(): ReadBlockFromDisk() failed at %d, hash=%s", pindexOld->nHeight, pindexOld->GetBlockHash().ToString());
+                }
+                pblock = pblockNew;
             }
+            const CBlock& block = *pblock;
             LogPrintf("Rolling back %s (%i)\n", pindexOld->GetBlockHash().ToString(), pindexOld->nHeight);
             DisconnectResult res = DisconnectBlock(block, pindexOld, cache);
             if (res == DISCONNECT_FAILED) {
@@ -5203,6 +5688,7 @@ void UnloadBlockIndex()
     LOCK(cs_main);
     ::ChainActive().SetTip(nullptr);
     g_blockman.Unload();
+    g_recent_undo.Clear();
     pindexBestInvalid = nullptr;
     pindexBestHeader = nullptr;
     mempool.clear();
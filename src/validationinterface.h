@@ -12,7 +12,7 @@
 #include <functional>
 #include <memory>
 
-extern RecursiveMutex cs_main;
+extern TimedRecursiveMutex cs_main;
 class BlockValidationState;
 class CBlock;
 class CBlockIndex;
@@ -21,6 +21,7 @@ class CConnman;
 class CValidationInterface;
 class uint256;
 class CScheduler;
+enum class MemPoolRemovalReason;
 
 // These functions dispatch to one or all registered wallets
 
@@ -96,7 +97,7 @@ protected:
      *
      * Called on a background thread.
      */
-    virtual void TransactionAddedToMempool(const CTransactionRef &ptxn) {}
+    virtual void TransactionAddedToMempool(const CTransactionRef &ptxn, uint64_t mempool_sequence) {}
     /**
      * Notifies listeners of a transaction leaving mempool.
      *
@@ -108,11 +109,13 @@ protected:
      * - REORG (removed during a reorg)
      * - CONFLICT (removed because it conflicts with in-block transaction)
      * - REPLACED (removed due to RBF replacement)
+     * - BLOCK (removed because it was included in a connected block)
      *
-     * This does not fire for transactions that are removed from the mempool
-     * because they have been included in a block. Any client that is interested
-     * in transactions removed from the mempool for inclusion in a block can learn
-     * about those transactions from the BlockConnected notification.
+     * Clients only interested in what is left unconfirmed should ignore the
+     * BLOCK reason and learn about those transactions from BlockConnected.
+     *
+     * mempool_sequence orders additions and removals against each other and
+     * against CTxMemPool::GetSequence() snapshots.
      *
      * Transactions that are removed from the mempool because they conflict
      * with a transaction in the new block will have
@@ -129,7 +132,7 @@ protected:
      *
      * Called on a background thread.
      */
-    virtual void TransactionRemovedFromMempool(const CTransactionRef &ptx) {}
+    virtual void TransactionRemovedFromMempool(const CTransactionRef &ptx, MemPoolRemovalReason reason, uint64_t mempool_sequence) {}
     /**
      * Notifies listeners of a block being connected.
      * Provides a vector of transactions evicted from the mempool as a result.
@@ -196,8 +199,8 @@ public:
 
 
     void UpdatedBlockTip(const CBlockIndex *, const CBlockIndex *, bool fInitialDownload);
-    void TransactionAddedToMempool(const CTransactionRef &);
-    void TransactionRemovedFromMempool(const CTransactionRef &);
+    void TransactionAddedToMempool(const CTransactionRef &, uint64_t mempool_sequence);
+    void TransactionRemovedFromMempool(const CTransactionRef &, MemPoolRemovalReason, uint64_t mempool_sequence);
     void BlockConnected(const std::shared_ptr<const CBlock> &, const CBlockIndex *pindex);
     void BlockDisconnected(const std::shared_ptr<const CBlock> &, const CBlockIndex* pindex);
     void ChainStateFlushed(const CBlockLocator &);
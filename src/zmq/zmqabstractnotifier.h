@@ -7,8 +7,11 @@
 
 #include <zmq/zmqconfig.h>
 
+#include <stdint.h>
+
 class CBlockIndex;
 class CZMQAbstractNotifier;
+enum class MemPoolRemovalReason;
 
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
 
@@ -43,6 +46,12 @@ public:
     virtual bool NotifyBlock(const CBlockIndex *pindex);
     virtual bool NotifyTransaction(const CTransaction &transaction);
 
+    // Notifications for the mempool change feed
+    virtual bool NotifyBlockConnect(const CBlockIndex *pindex);
+    virtual bool NotifyBlockDisconnect(const CBlockIndex *pindex);
+    virtual bool NotifyTransactionAcceptance(const CTransaction &transaction, uint64_t mempool_sequence);
+    virtual bool NotifyTransactionRemoval(const CTransaction &transaction, MemPoolRemovalReason reason, uint64_t mempool_sequence);
+
 protected:
     void *psocket;
     std::string type;
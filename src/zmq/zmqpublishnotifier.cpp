@@ -5,6 +5,7 @@
 #include <chain.h>
 #include <chainparams.h>
 #include <streams.h>
+#include <txmempool.h>
 #include <zmq/zmqpublishnotifier.h>
 #include <validation.h>
 #include <util/system.h>
@@ -16,6 +17,7 @@ static const char *MSG_HASHBLOCK = "hashblock";
 static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
+static const char *MSG_SEQUENCE  = "sequence";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -207,3 +209,54 @@ bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &tr
     ss << transaction;
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
+
+// Send a 'sequence' topic message with the following structure:
+//    <32-byte hash> | <1-byte label> | <8-byte LE mempool sequence> (transaction events only)
+static bool SendSequenceMsg(CZMQAbstractPublishNotifier& notifier, const uint256& hash, char label, const uint64_t* sequence)
+{
+    unsigned char data[sizeof(uint256) + sizeof(label) + sizeof(uint64_t)];
+    for (unsigned int i = 0; i < sizeof(uint256); ++i) {
+        data[sizeof(uint256) - 1 - i] = hash.begin()[i];
+    }
+    data[sizeof(uint256)] = label;
+    size_t size = sizeof(uint256) + sizeof(label);
+    if (sequence) {
+        WriteLE64(data + size, *sequence);
+        size += sizeof(uint64_t);
+    }
+    return notifier.SendMessage(MSG_SEQUENCE, data, size);
+}
+
+bool CZMQPublishSequenceNotifier::NotifyBlockConnect(const CBlockIndex *pindex)
+{
+    uint256 hash = pindex->GetBlockHash();
+    LogPrint(BCLog::ZMQ, "zmq: Publish sequence block connect %s\n", hash.GetHex());
+    return SendSequenceMsg(*this, hash, /* Block (C)onnect */ 'C', nullptr);
+}
+
+bool CZMQPublishSequenceNotifier::NotifyBlockDisconnect(const CBlockIndex *pindex)
+{
+    uint256 hash = pindex->GetBlockHash();
+    LogPrint(BCLog::ZMQ, "zmq: Publish sequence block disconnect %s\n", hash.GetHex());
+    return SendSequenceMsg(*this, hash, /* Block (D)isconnect */ 'D', nullptr);
+}
+
+bool CZMQPublishSequenceNotifier::NotifyTransactionAcceptance(const CTransaction &transaction, uint64_t mempool_sequence)
+{
+    uint256 hash = transaction.GetHash();
+    LogPrint(BCLog::ZMQ, "zmq: Publish sequence mempool acceptance %s\n", hash.GetHex());
+    return SendSequenceMsg(*this, hash, /* Mempool (A)cceptance */ 'A', &mempool_sequence);
+}
+
+bool CZMQPublishSequenceNotifier::NotifyTransactionRemoval(const CTransaction &transaction, MemPoolRemovalReason reason, uint64_t mempool_sequence)
+{
+    uint256 hash = transaction.GetHash();
+    LogPrint(BCLog::ZMQ, "zmq: Publish sequence mempool removal %s\n", hash.GetHex());
+    char label;
+    switch (reason) {
+    case MemPoolRemovalReason::BLOCK: label = 'B'; break;    // included in a (B)lock
+    case MemPoolRemovalReason::REPLACED: label = 'P'; break; // re(P)laced
+    default: label = 'R'; break;                             // (R)emoved for any other reason
+    }
+    return SendSequenceMsg(*this, hash, label, &mempool_sequence);
+}
@@ -303,6 +303,11 @@ class RESTTest (BitcoinTestFramework):
             assert_equal(json_obj[tx]['spentby'], txs[i + 1:i + 2])
             assert_equal(json_obj[tx]['depends'], txs[i - 1:i])
 
+        # Check the snapshot lists the same transactions
+        json_obj = self.test_rest_request("/mempool/snapshot")
+        assert_equal(sorted(json_obj['txids']), sorted(txs))
+        snapshot_sequence = json_obj['sequence']
+
         # Now mine the transactions
         newblockhash = self.nodes[1].generate(1)
         self.sync_all()
@@ -313,6 +318,11 @@ class RESTTest (BitcoinTestFramework):
                             if 'coinbase' not in tx['vin'][0]}
         assert_equal(non_coinbase_txs, set(txs))
 
+        # Removing the mined transactions advanced the mempool sequence
+        json_obj = self.test_rest_request("/mempool/snapshot")
+        assert_equal(json_obj['txids'], [])
+        assert_equal(json_obj['sequence'], snapshot_sequence + len(txs))
+
         # Check the same but without tx details
         json_obj = self.test_rest_request("/block/notxdetails/{}".format(newblockhash[0]))
         for tx in txs:
@@ -325,5 +335,13 @@ class RESTTest (BitcoinTestFramework):
         json_obj = self.test_rest_request("/chaininfo")
         assert_equal(json_obj['bestblockhash'], bb_hash)
 
+        self.log.info("Test the /feeestimates URI")
+
+        json_obj = self.test_rest_request("/feeestimates")
+        for mode in ['economical', 'conservative']:
+            assert mode in json_obj
+            blocks = [entry['blocks'] for entry in json_obj[mode]]
+            assert_equal(blocks, sorted(set(blocks)))
+
 if __name__ == '__main__':
     RESTTest().main()
@@ -3,7 +3,10 @@
 # Distributed under the MIT software license, see the accompanying
 # file COPYING or http://www.opensource.org/licenses/mit-license.php.
 """Test the ZMQ notification interface."""
+import http.client
+import json
 import struct
+import urllib.parse
 
 from test_framework.address import ADDRESS_BCRT1_UNSPENDABLE
 from test_framework.test_framework import BitcoinTestFramework
@@ -48,6 +51,7 @@ class ZMQTest (BitcoinTestFramework):
         try:
             self.test_basic()
             self.test_reorg()
+            self.test_sequence()
         finally:
             # Destroy the ZMQ context.
             self.log.debug("Destroying ZMQ context")
@@ -156,5 +160,104 @@ class ZMQTest (BitcoinTestFramework):
         # Should receive nodes[1] tip
         assert_equal(self.nodes[1].getbestblockhash(), hashblock.receive().hex())
 
+    def test_sequence(self):
+        """
+        Sequence zmq notifications give every mempool addition and removal
+        the next mempool sequence number, which continues from the number
+        returned by /rest/mempool/snapshot:
+        <32-byte hash>A<8-byte LE uint> : Transactionhash added to mempool
+        <32-byte hash>R<8-byte LE uint> : Transactionhash removed from mempool
+        <32-byte hash>P<8-byte LE uint> : Transactionhash replaced in mempool
+        <32-byte hash>B<8-byte LE uint> : Transactionhash included in a block
+        <32-byte hash>C                 : Blockhash connected
+        <32-byte hash>D                 : Blockhash disconnected
+        """
+        self.log.info("Testing 'sequence' publisher")
+        import zmq
+        address = 'tcp://127.0.0.1:28334'
+        socket = self.ctx.socket(zmq.SUB)
+        socket.set(zmq.RCVTIMEO, 60000)
+        seq = ZMQSubscriber(socket, b'sequence')
+
+        self.restart_node(0, ['-zmqpub%s=%s' % (seq.topic.decode(), address), '-rest'])
+        connect_nodes(self.nodes[0], 1)
+        socket.connect(address)
+        # Relax so that the subscriber is ready before publishing zmq messages
+        sleep(0.2)
+
+        def receive_sequence():
+            body = seq.receive()
+            hash = body[:32].hex()
+            label = chr(body[32])
+            mempool_sequence = None
+            if len(body) == 32 + 1 + 8:
+                mempool_sequence = struct.unpack("<Q", body[32 + 1:])[0]
+            else:
+                assert_equal(len(body), 32 + 1)
+            # Only transaction events carry a mempool sequence number
+            assert_equal(mempool_sequence is None, label in "CD")
+            return hash, label, mempool_sequence
+
+        def mempool_snapshot():
+            url = urllib.parse.urlparse(self.nodes[0].url)
+            conn = http.client.HTTPConnection(url.hostname, url.port)
+            conn.request('GET', '/rest/mempool/snapshot.json')
+            resp = conn.getresponse()
+            assert_equal(resp.status, 200)
+            snapshot = json.loads(resp.read().decode('utf-8'))
+            assert_equal(sorted(snapshot['txids']), sorted(self.nodes[0].getrawmempool()))
+            return snapshot
+
+        self.log.info("Block connection")
+        blockhash = self.nodes[0].generatetoaddress(1, ADDRESS_BCRT1_UNSPENDABLE)[0]
+        assert_equal((blockhash, "C", None), receive_sequence())
+        snapshot = mempool_snapshot()
+        assert_equal(snapshot['txids'], [])
+        mempool_seq = snapshot['sequence']
+
+        if self.is_wallet_compiled():
+            self.log.info("Mempool addition continues from the snapshot sequence")
+            txid = self.nodes[0].sendtoaddress(self.nodes[1].getnewaddress(), 1.0, "", "", False, True)
+            assert_equal((txid, "A", mempool_seq), receive_sequence())
+            snapshot = mempool_snapshot()
+            assert_equal(snapshot['txids'], [txid])
+            assert_equal(snapshot['sequence'], mempool_seq + 1)
+
+            self.log.info("Replacement removes the original, then adds the replacement")
+            bump_txid = self.nodes[0].bumpfee(txid)["txid"]
+            assert_equal((txid, "P", mempool_seq + 1), receive_sequence())
+            assert_equal((bump_txid, "A", mempool_seq + 2), receive_sequence())
+            snapshot = mempool_snapshot()
+            assert_equal(snapshot['txids'], [bump_txid])
+            assert_equal(snapshot['sequence'], mempool_seq + 3)
+
+            self.log.info("Inclusion in a block is reported before the block")
+            blockhash = self.nodes[0].generatetoaddress(1, ADDRESS_BCRT1_UNSPENDABLE)[0]
+            assert_equal((bump_txid, "B", mempool_seq + 3), receive_sequence())
+            assert_equal((blockhash, "C", None), receive_sequence())
+            snapshot = mempool_snapshot()
+            assert_equal(snapshot['txids'], [])
+            assert_equal(snapshot['sequence'], mempool_seq + 4)
+
+            self.log.info("Disconnecting the block returns the transaction to the mempool")
+            self.nodes[0].invalidateblock(blockhash)
+            assert_equal((blockhash, "D", None), receive_sequence())
+            assert_equal((bump_txid, "A", mempool_seq + 4), receive_sequence())
+            snapshot = mempool_snapshot()
+            assert_equal(snapshot['txids'], [bump_txid])
+            assert_equal(snapshot['sequence'], mempool_seq + 5)
+
+            self.nodes[0].reconsiderblock(blockhash)
+            assert_equal((bump_txid, "B", mempool_seq + 5), receive_sequence())
+            assert_equal((blockhash, "C", None), receive_sequence())
+            snapshot = mempool_snapshot()
+            assert_equal(snapshot['txids'], [])
+            assert_equal(snapshot['sequence'], mempool_seq + 6)
+
+        self.log.info("Test the getzmqnotifications RPC for the sequence publisher")
+        assert_equal(self.nodes[0].getzmqnotifications(), [
+            {"type": "pubsequence", "address": address, "hwm": 1000},
+        ])
+
 if __name__ == '__main__':
     ZMQTest().main()
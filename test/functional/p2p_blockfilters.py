@@ -0,0 +1,180 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Tests NODE_COMPACT_FILTERS (BIP 157/158).
+
+Tests that a node configured with -blockfilterindex and -peerblockfilters signals
+NODE_COMPACT_FILTERS and can serve cfilters, cfheaders and cfcheckpts.
+"""
+
+from test_framework.messages import (
+    FILTER_TYPE_BASIC,
+    NODE_COMPACT_FILTERS,
+    hash256,
+    msg_getcfcheckpt,
+    msg_getcfheaders,
+    msg_getcfilters,
+    ser_uint256,
+    uint256_from_str,
+)
+from test_framework.mininode import P2PInterface
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    wait_until,
+)
+
+
+class CFiltersClient(P2PInterface):
+    def __init__(self):
+        super().__init__()
+        # Store the cfilters received.
+        self.cfilters = []
+
+    def pop_cfilters(self):
+        cfilters = self.cfilters
+        self.cfilters = []
+        return cfilters
+
+    def on_cfilter(self, message):
+        """Store cfilters received in a list."""
+        self.cfilters.append(message)
+
+
+class CompactFiltersTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+        self.extra_args = [
+            ["-blockfilterindex", "-peerblockfilters"],
+            ["-blockfilterindex"],
+        ]
+
+    def run_test(self):
+        # Node 0 supports COMPACT_FILTERS, node 1 does not.
+        node0 = self.nodes[0].add_p2p_connection(CFiltersClient())
+        node1 = self.nodes[1].add_p2p_connection(CFiltersClient())
+
+        # Nodes 0 & 1 share the same first 999 blocks in the chain.
+        self.nodes[0].generate(999)
+        self.sync_blocks(timeout=600)
+
+        # Extend the chain past the first checkpoint interval.
+        self.nodes[0].generate(11)
+        self.sync_blocks(timeout=600)
+
+        stop_height = 1010
+        assert_equal(self.nodes[0].getblockcount(), stop_height)
+        stop_hash = self.nodes[0].getbestblockhash()
+
+        # Wait for the filter index to catch up with the tip.
+        wait_until(lambda: self.nodes[0].getblockfilter(stop_hash)["filter"] != "", timeout=60)
+
+        self.log.info("Check that nodes have signalled NODE_COMPACT_FILTERS correctly.")
+        assert node0.nServices & NODE_COMPACT_FILTERS != 0
+        assert node1.nServices & NODE_COMPACT_FILTERS == 0
+
+        self.log.info("Check that a getcfcheckpt request returns the filter header of each checkpoint.")
+        request = msg_getcfcheckpt(
+            filter_type=FILTER_TYPE_BASIC,
+            stop_hash=int(stop_hash, 16)
+        )
+        node0.send_and_ping(request)
+        response = node0.last_message['cfcheckpt']
+        assert_equal(response.stop_hash, request.stop_hash)
+        assert_equal(len(response.headers), 1)
+        checkpoint_hash = self.nodes[0].getblockhash(1000)
+        checkpoint_header = self.nodes[0].getblockfilter(checkpoint_hash, 'basic')['header']
+        assert_equal(response.headers[0], int(checkpoint_header, 16))
+
+        self.log.info("Check that getcfheaders returns headers chaining from the previous filter header.")
+        request = msg_getcfheaders(
+            filter_type=FILTER_TYPE_BASIC,
+            start_height=1001,
+            stop_hash=int(stop_hash, 16)
+        )
+        node0.send_and_ping(request)
+        response = node0.last_message['cfheaders']
+        assert_equal(response.stop_hash, request.stop_hash)
+        assert_equal(response.prev_header, int(checkpoint_header, 16))
+        assert_equal(len(response.hashes), stop_height - 1000)
+
+        header = ser_uint256(response.prev_header)
+        for filter_hash in response.hashes:
+            header = hash256(ser_uint256(filter_hash) + header)
+        stop_header = self.nodes[0].getblockfilter(stop_hash, 'basic')['header']
+        assert_equal(uint256_from_str(header), int(stop_header, 16))
+
+        self.log.info("Check that getcfilters returns one filter per block in the range.")
+        request = msg_getcfilters(
+            filter_type=FILTER_TYPE_BASIC,
+            start_height=1,
+            stop_hash=int(stop_hash, 16)
+        )
+        node0.send_and_ping(request)
+        response = node0.pop_cfilters()
+        assert_equal(len(response), 1000)
+        for height, cfilter in enumerate(response, start=1):
+            block_hash = self.nodes[0].getblockhash(height)
+            assert_equal(cfilter.filter_type, FILTER_TYPE_BASIC)
+            assert_equal(cfilter.block_hash, int(block_hash, 16))
+            expected = self.nodes[0].getblockfilter(block_hash, 'basic')['filter']
+            assert_equal(cfilter.filter_data.hex(), expected)
+
+        self.log.info("Check that peers without NODE_COMPACT_FILTERS are disconnected on requests.")
+        requests = [
+            msg_getcfilters(
+                filter_type=FILTER_TYPE_BASIC,
+                start_height=1000,
+                stop_hash=int(stop_hash, 16)
+            ),
+            msg_getcfheaders(
+                filter_type=FILTER_TYPE_BASIC,
+                start_height=1000,
+                stop_hash=int(stop_hash, 16)
+            ),
+            msg_getcfcheckpt(
+                filter_type=FILTER_TYPE_BASIC,
+                stop_hash=int(stop_hash, 16)
+            ),
+        ]
+        for request in requests:
+            node1 = self.nodes[1].add_p2p_connection(P2PInterface())
+            node1.send_message(request)
+            node1.wait_for_disconnect()
+
+        self.log.info("Check that invalid requests result in disconnection.")
+        requests = [
+            # Requesting too many filters results in disconnection.
+            msg_getcfilters(
+                filter_type=FILTER_TYPE_BASIC,
+                start_height=0,
+                stop_hash=int(stop_hash, 16)
+            ),
+            # Requesting filter headers up to an unknown block results in disconnection.
+            msg_getcfheaders(
+                filter_type=FILTER_TYPE_BASIC,
+                start_height=0,
+                stop_hash=0
+            ),
+            # Requesting unknown filter type results in disconnection.
+            msg_getcfcheckpt(
+                filter_type=255,
+                stop_hash=int(stop_hash, 16)
+            ),
+            # Requesting a start height past the stop block results in disconnection.
+            msg_getcfheaders(
+                filter_type=FILTER_TYPE_BASIC,
+                start_height=stop_height + 1,
+                stop_hash=int(stop_hash, 16)
+            ),
+        ]
+        for request in requests:
+            node0 = self.nodes[0].add_p2p_connection(P2PInterface())
+            node0.send_message(request)
+            node0.wait_for_disconnect()
+
+
+if __name__ == '__main__':
+    CompactFiltersTest().main()
@@ -8,6 +8,7 @@ Test the following RPCs:
    - createrawtransaction
    - signrawtransactionwithwallet
    - sendrawtransaction
+   - sendrawtransactions
    - decoderawtransaction
    - getrawtransaction
 """
@@ -487,6 +488,24 @@ class RawTransactionsTest(BitcoinTestFramework):
         assert_equal(testres['allowed'], True)
         self.nodes[2].sendrawtransaction(hexstring=rawTxSigned['hex'], maxfeerate='0.20000000')
 
+        self.log.info('sendrawtransactions with a child given before its parent')
+
+        txId = self.nodes[0].sendtoaddress(self.nodes[2].getnewaddress(), 1.0)
+        rawTx = self.nodes[0].getrawtransaction(txId, True)
+        vout = next(o for o in rawTx['vout'] if o['value'] == Decimal('1.00000000'))
+        self.sync_all()
+        address = self.nodes[2].getnewaddress()
+        parentSigned = self.nodes[2].signrawtransactionwithwallet(self.nodes[2].createrawtransaction([{"txid": txId, "vout": vout['n']}], {address: Decimal("0.99990000")}))
+        parentTxId = self.nodes[2].decoderawtransaction(parentSigned['hex'])['txid']
+        childSigned = self.nodes[2].signrawtransactionwithwallet(self.nodes[2].createrawtransaction([{"txid": parentTxId, "vout": 0}], {self.nodes[0].getnewaddress(): Decimal("0.99980000")}),
+                                                                [{"txid": parentTxId, "vout": 0, "scriptPubKey": self.nodes[2].getaddressinfo(address)['scriptPubKey'], "amount": Decimal("0.99990000")}])
+        assert_equal(childSigned['complete'], True)
+        results = self.nodes[2].sendrawtransactions([childSigned['hex'], parentSigned['hex']])
+        assert_equal([r['accepted'] for r in results], [True, True])
+        assert_equal(results[1]['txid'], parentTxId)
+        assert parentTxId in self.nodes[2].getrawmempool()
+        assert_raises_rpc_error(-8, "Too many transactions: 1001, the maximum is 1000", self.nodes[2].sendrawtransactions, [childSigned['hex']] * 1001)
+
 
 if __name__ == '__main__':
     RawTransactionsTest().main()